@@ -0,0 +1,151 @@
+#!/bin/bash
+
+# Compile-time and code-size benchmark for the per-type cost of value_ptr.
+#
+# Every type D stored in a value_ptr instantiates a model class with its own
+# vtable and virtual functions, which adds up to link time and .text size in
+# programs with thousands of derived types. For each N given (64, 256 and
+# 1024 by default), this generates a source file declaring N types in closed
+# hierarchies of 8, each of which is stored and copied in one of:
+#
+#   unique_ptr  std::unique_ptr<Base>; the baseline, with no per-type
+#               dispatch beyond the types' own vtables (and no copies)
+#   value_ptr   value_ptr<Base>, with a pmr_inline_model<D> per type
+#   tagged      tagged_value_ptr<Base, D...>, which dispatches through one
+#               table of function pointers per hierarchy
+#
+# and reports the time taken to compile it at -O2, the size of the object
+# file and of its .text section, and the number and total size of the vtables
+# it defines.
+#
+# Usage: instantiation-cost.sh [N...]
+
+CXX=@CMAKE_CXX_COMPILER@
+INCLUDE=@VP_INCLUDE_DIR@
+
+# Types per hierarchy, which is as many as tagged_value_ptr can tell apart in
+# the alignment of a Base with a vtable on a 64-bit system.
+GROUP=8
+
+SIZES=("$@")
+if [ ${#SIZES[@]} -eq 0 ]; then
+  SIZES=(64 256 1024)
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# generate strategy groups
+#
+# Writes a source file with groups * GROUP derived types stored using the
+# given strategy to standard output.
+generate() {
+  local strategy=$1
+  local groups=$2
+
+  echo "#include <value_ptr/tagged.h>"
+  echo "#include <value_ptr/value_ptr.h>"
+  echo "#include <memory>"
+  echo "#include <vector>"
+  echo "using namespace bsc;"
+
+  for ((g = 0; g < groups; ++g)); do
+    echo "struct b$g { virtual ~b$g() {} virtual int f() const = 0; };"
+
+    local types=()
+    for ((i = 0; i < GROUP; ++i)); do
+      echo "struct d${g}_$i final : b$g {"
+      echo "  int f() const override { return $i; }"
+      echo "};"
+      types+=("d${g}_$i")
+    done
+
+    local list
+    list=$(IFS=,; echo "${types[*]}")
+
+    case $strategy in
+      unique_ptr)
+        echo "int use$g() {"
+        echo "  std::vector<std::unique_ptr<b$g>> v;"
+        for t in "${types[@]}"; do
+          echo "  v.emplace_back(new $t());"
+        done
+        echo "  return v.back()->f();"
+        echo "}"
+        ;;
+      value_ptr)
+        echo "int use$g() {"
+        echo "  std::vector<value_ptr<b$g>> v;"
+        for t in "${types[@]}"; do
+          echo "  v.push_back(make_derived_val<b$g, $t>());"
+        done
+        echo "  auto copy = v;"
+        echo "  return copy.back()->f();"
+        echo "}"
+        ;;
+      tagged)
+        echo "int use$g() {"
+        echo "  std::vector<tagged_value_ptr<b$g, $list>> v;"
+        for t in "${types[@]}"; do
+          echo "  v.emplace_back(in_place_type_t<$t>{});"
+        done
+        echo "  auto copy = v;"
+        echo "  return copy.back()->f();"
+        echo "}"
+        ;;
+    esac
+  done
+
+  echo "int use_all() {"
+  echo "  int sum = 0;"
+  for ((g = 0; g < groups; ++g)); do
+    echo "  sum += use$g();"
+  done
+  echo "  return sum;"
+  echo "}"
+}
+
+# The total size in bytes and number of the vtables (_ZTV symbols) defined in
+# an object file.
+vtables() {
+  local total=0
+  local count=0
+  local size
+
+  while read -r size; do
+    total=$((total + 16#$size))
+    count=$((count + 1))
+  done < <(nm -S --defined-only "$1" | awk '$4 ~ /^_ZTV/ { print $2 }')
+
+  echo "$count $total"
+}
+
+printf "%-12s %6s %10s %12s %12s %8s %14s\n" \
+  strategy types compile_s object_bytes text_bytes vtables vtable_bytes
+
+for n in "${SIZES[@]}"; do
+  groups=$(((n + GROUP - 1) / GROUP))
+
+  for strategy in unique_ptr value_ptr tagged; do
+    src="$WORK/$strategy-$n.cpp"
+    obj="$WORK/$strategy-$n.o"
+    generate $strategy $groups > "$src"
+
+    start=$(date +%s%N)
+    if ! $CXX -std=c++11 -O2 -c "-I$INCLUDE" "$src" -o "$obj"; then
+      echo "failed to compile $src"
+      exit 1
+    fi
+    end=$(date +%s%N)
+
+    seconds=$(awk -v ns=$((end - start)) 'BEGIN { printf "%.2f", ns / 1e9 }')
+    object_bytes=$(wc -c < "$obj")
+    text_bytes=$(size -A "$obj" | awk '$1 ~ /^\.text/ { sum += $2 }
+      END { print sum + 0 }')
+    read -r vtable_count vtable_bytes < <(vtables "$obj")
+
+    printf "%-12s %6d %10s %12d %12d %8d %14d\n" $strategy \
+      $((groups * GROUP)) "$seconds" "$object_bytes" "$text_bytes" \
+      "$vtable_count" "$vtable_bytes"
+  done
+done
@@ -0,0 +1,107 @@
+/**
+ * Pointer-chasing benchmark for huge_page_arena.
+ *
+ * Builds a cycle through N value_ptr payloads in a random order, so that each
+ * hop lands on an unpredictable page, then times walking it with payloads
+ * allocated from the heap and from huge_page_arena. Once the working set is
+ * larger than the TLB covers with 4 KiB pages, the difference between the two
+ * is mostly the cost of page walks; run under
+ *
+ *   perf stat -e dTLB-loads,dTLB-load-misses ./valueptr-pointer-chase
+ *
+ * to see the miss rates directly.
+ *
+ * Usage: valueptr-pointer-chase [nodes] [hops]
+ */
+#include <value_ptr/arena.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct node {
+  node* next = nullptr;
+  std::uint64_t payload = 0;
+};
+
+/**
+ * Link the nodes into a single random cycle and time hops steps around it,
+ * returning nanoseconds per hop.
+ */
+double chase(std::vector<value_ptr<node>>& nodes, std::size_t hops)
+{
+  auto order = std::vector<std::size_t>(nodes.size());
+  std::iota(order.begin(), order.end(), std::size_t(0));
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+
+  for (auto i = std::size_t(0); i < order.size(); ++i) {
+    nodes[order[i]]->next = nodes[order[(i + 1) % order.size()]].get();
+  }
+
+  auto current = nodes[order[0]].get();
+  auto sum = std::uint64_t(0);
+
+  auto const start = std::chrono::steady_clock::now();
+  for (auto i = std::size_t(0); i < hops; ++i) {
+    sum += current->payload;
+    current = current->next;
+  }
+  auto const end = std::chrono::steady_clock::now();
+
+  // Keep the loop from being optimised away.
+  if (sum == 1) {
+    std::puts("");
+  }
+
+  return std::chrono::duration<double, std::nano>(end - start).count()
+      / static_cast<double>(hops);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  auto const count
+      = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1ull << 23);
+  auto const hops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : count * 4;
+
+  std::printf("%llu nodes, %llu hops\n",
+      static_cast<unsigned long long>(count),
+      static_cast<unsigned long long>(hops));
+
+  {
+    auto nodes = std::vector<value_ptr<node>>{};
+    nodes.reserve(count);
+    for (auto i = std::size_t(0); i < count; ++i) {
+      nodes.push_back(make_val<node>());
+    }
+
+    std::printf("%-16s %6.2f ns/hop\n", "heap:", chase(nodes, hops));
+  }
+
+  for (auto use_hugetlb : { true, false }) {
+    huge_page_arena arena(use_hugetlb);
+
+    auto nodes = std::vector<value_ptr<node>>{};
+    nodes.reserve(count);
+    for (auto i = std::size_t(0); i < count; ++i) {
+      nodes.push_back(make_arena_val<node>(arena));
+    }
+
+    using kind = huge_page_arena::page_kind;
+    std::printf("%-16s %6.2f ns/hop [regions: %zu hugetlb, "
+                "%zu transparent, %zu normal]\n",
+        use_hugetlb ? "arena (hugetlb):" : "arena (thp):", chase(nodes, hops),
+        arena.regions(kind::hugetlb), arena.regions(kind::transparent),
+        arena.regions(kind::normal));
+  }
+}
@@ -0,0 +1,323 @@
+/**
+ * An arena for value_ptr payloads backed by huge pages.
+ *
+ * A large working set of small heap objects is spread over a great many 4 KiB
+ * pages, and following pointers between them misses in the TLB. Allocating
+ * the objects from 2 MiB regions mapped with huge pages lets one TLB entry
+ * cover 512 times as much of the working set.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define VP_HAS_MMAP 1
+#endif
+
+namespace bsc {
+
+namespace detail {
+
+/**
+ * The size and alignment of each region of a huge_page_arena, which is the
+ * size of a huge page on x86-64 and (with 4 KiB base pages) on AArch64.
+ */
+constexpr std::size_t arena_region_size = std::size_t(2) << 20;
+
+/**
+ * Blocks start this far into a region, after its header, so that blocks whose
+ * size is a multiple of a page are page-aligned.
+ */
+constexpr std::size_t arena_max_alignment = 4096;
+
+/**
+ * Size classes are multiples of 16 bytes up to 256 bytes, followed by powers
+ * of two up to arena_max_block_size.
+ */
+constexpr std::size_t arena_small_classes = 16;
+constexpr std::size_t arena_class_count = arena_small_classes + 8;
+constexpr std::size_t arena_max_block_size = std::size_t(64) << 10;
+
+inline std::size_t arena_class_size(std::size_t size_class) noexcept
+{
+  return size_class < arena_small_classes
+      ? (size_class + 1) * 16
+      : std::size_t(512) << (size_class - arena_small_classes);
+}
+
+inline std::size_t arena_size_class(std::size_t size) noexcept
+{
+  if (size <= arena_small_classes * 16) {
+    return size == 0 ? 0 : (size - 1) / 16;
+  }
+
+  auto size_class = arena_small_classes;
+  while (arena_class_size(size_class) < size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+} // namespace detail
+
+/**
+ * Thread-safe slab allocator for value_ptr payloads, allocating from regions
+ * of memory backed by huge pages where the system provides them.
+ *
+ * Pass an arena to the value_ptr constructor taking one, or to make_arena_val;
+ * copies of the object are then allocated from the same arena. The arena must
+ * outlive every value_ptr allocated from it.
+ *
+ * Every region holds blocks of a single size class and begins with a header
+ * naming its arena and class, so that a block can be freed given only its
+ * address. Freed blocks are kept for reuse by the same arena, and regions are
+ * only returned to the system when the arena is destroyed.
+ *
+ * Blocks (the object plus 32 bytes of bookkeeping) may be up to 64 KiB, with
+ * alignment up to 4096 bytes. A single mutex guards the arena, so threads that
+ * allocate heavily should each use their own.
+ */
+class huge_page_arena {
+public:
+  /**
+   * How the pages of a region were obtained.
+   */
+  enum class page_kind {
+    // Explicitly reserved huge pages (hugetlbfs).
+    hugetlb,
+    // Ordinary pages advised with MADV_HUGEPAGE; the kernel backs them with
+    // transparent huge pages when it can.
+    transparent,
+    // Ordinary pages.
+    normal,
+  };
+
+  /**
+   * Construct an empty arena.
+   *
+   * If use_hugetlb is true, regions are mapped from the pool of reserved huge
+   * pages while it lasts (on Linux, see /proc/sys/vm/nr_hugepages), then from
+   * transparent huge pages.
+   */
+  explicit huge_page_arena(bool use_hugetlb = true) noexcept
+      : use_hugetlb_(use_hugetlb)
+  {
+  }
+
+  huge_page_arena(huge_page_arena const&) = delete;
+  huge_page_arena& operator=(huge_page_arena const&) = delete;
+
+  /**
+   * Unmaps every region; all blocks must have been freed.
+   */
+  ~huge_page_arena()
+  {
+    while (regions_) {
+      auto r = regions_;
+      regions_ = r->next;
+      unmap(r);
+    }
+  }
+
+  /**
+   * Allocate a block of at least size bytes aligned to align, throwing
+   * std::bad_alloc if they exceed the limits above or no memory is available.
+   */
+  void* allocate(std::size_t size, std::size_t align)
+  {
+    auto block = try_allocate(size, align);
+    if (!block) {
+      VP_THROW(std::bad_alloc());
+    }
+    return block;
+  }
+
+  /**
+   * Allocate as above, returning null instead of throwing.
+   */
+  void* try_allocate(std::size_t size, std::size_t align) noexcept
+  {
+    if (align > detail::arena_max_alignment) {
+      return nullptr;
+    }
+
+    // The class size the rounded size falls into is then a multiple of align
+    // too, and blocks start at a page boundary, so every block is aligned.
+    size = (size + align - 1) & ~(align - 1);
+    if (size > detail::arena_max_block_size) {
+      return nullptr;
+    }
+
+    auto const size_class = detail::arena_size_class(size);
+    auto const block_size = detail::arena_class_size(size_class);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slab = slabs_[size_class];
+
+    if (slab.free) {
+      auto block = slab.free;
+      slab.free = block->next;
+      return block;
+    }
+
+    if (static_cast<std::size_t>(slab.end - slab.next) < block_size) {
+      auto r = map_region(size_class);
+      if (!r) {
+        return nullptr;
+      }
+
+      slab.next = reinterpret_cast<char*>(r) + detail::arena_max_alignment;
+      slab.end = reinterpret_cast<char*>(r) + detail::arena_region_size;
+    }
+
+    auto block = slab.next;
+    slab.next += block_size;
+    return block;
+  }
+
+  /**
+   * Free a block allocated by any huge_page_arena.
+   */
+  static void deallocate(void* ptr) noexcept
+  {
+    if (!ptr) {
+      return;
+    }
+
+    auto r = reinterpret_cast<region*>(reinterpret_cast<std::uintptr_t>(ptr)
+        & ~(detail::arena_region_size - 1));
+    r->owner->free(r->size_class, ptr);
+  }
+
+  /**
+   * The number of regions mapped so far with pages of the given kind.
+   */
+  std::size_t regions(page_kind kind) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto count = std::size_t(0);
+    for (auto r = regions_; r; r = r->next) {
+      count += r->kind == kind;
+    }
+    return count;
+  }
+
+private:
+  struct region {
+    huge_page_arena* owner;
+    std::size_t size_class;
+    page_kind kind;
+    region* next;
+  };
+
+  struct free_block {
+    free_block* next;
+  };
+
+  struct slab {
+    free_block* free = nullptr;
+    char* next = nullptr;
+    char* end = nullptr;
+  };
+
+  void free(std::size_t size_class, void* ptr) noexcept
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slab = slabs_[size_class];
+    slab.free = ::new (ptr) free_block{ slab.free };
+  }
+
+  region* map_region(std::size_t size_class) noexcept
+  {
+    auto kind = page_kind::normal;
+    auto memory = map(kind);
+    if (!memory) {
+      return nullptr;
+    }
+
+    regions_ = ::new (memory) region{ this, size_class, kind, regions_ };
+    return regions_;
+  }
+
+  // Returns null if no memory is available.
+  void* map(page_kind& kind) noexcept
+  {
+#if defined(VP_HAS_MMAP)
+    auto const prot = PROT_READ | PROT_WRITE;
+    auto const flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#if defined(MAP_HUGETLB)
+    if (use_hugetlb_) {
+      auto huge_flags = flags | MAP_HUGETLB;
+#if defined(MAP_HUGE_2MB)
+      huge_flags |= MAP_HUGE_2MB;
+#endif
+      auto memory = ::mmap(
+          nullptr, detail::arena_region_size, prot, huge_flags, -1, 0);
+      if (memory != MAP_FAILED) {
+        kind = page_kind::hugetlb;
+        return memory;
+      }
+
+      // The pool is exhausted or was never reserved; don't keep asking.
+      use_hugetlb_ = false;
+    }
+#endif
+
+    // Map twice the size needed, and cut an aligned region out of the middle.
+    auto raw = ::mmap(
+        nullptr, 2 * detail::arena_region_size, prot, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+      return nullptr;
+    }
+
+    auto const begin = reinterpret_cast<std::uintptr_t>(raw);
+    auto const end = begin + 2 * detail::arena_region_size;
+    auto const aligned = (begin + detail::arena_region_size - 1)
+        & ~(detail::arena_region_size - 1);
+
+    if (aligned != begin) {
+      ::munmap(raw, aligned - begin);
+    }
+    if (aligned + detail::arena_region_size != end) {
+      ::munmap(reinterpret_cast<void*>(aligned + detail::arena_region_size),
+          end - aligned - detail::arena_region_size);
+    }
+
+    auto memory = reinterpret_cast<void*>(aligned);
+#if defined(MADV_HUGEPAGE)
+    if (::madvise(memory, detail::arena_region_size, MADV_HUGEPAGE) == 0) {
+      kind = page_kind::transparent;
+    }
+#endif
+    return memory;
+#else
+    kind = page_kind::normal;
+    return detail::try_allocate(
+        detail::arena_region_size, detail::arena_region_size);
+#endif
+  }
+
+  static void unmap(region* r) noexcept
+  {
+#if defined(VP_HAS_MMAP)
+    ::munmap(r, detail::arena_region_size);
+#else
+    detail::deallocate(r, detail::arena_region_size);
+#endif
+  }
+
+  mutable std::mutex mutex_;
+  bool use_hugetlb_;
+  slab slabs_[detail::arena_class_count];
+  region* regions_ = nullptr;
+};
+
+} // namespace bsc
@@ -0,0 +1,213 @@
+/**
+ * A value_ptr that can only be deep-copied explicitly.
+ *
+ * The implicit copy constructor of value_ptr makes it convenient, but also
+ * makes expensive deep copies easy to write by accident (e.g. `auto x =
+ * member;`). explicit_value_ptr has the same value semantics with the copy
+ * constructor deleted, so every copy has to be spelled out with clone() and
+ * can be audited at compile time.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace bsc {
+
+/**
+ * Smart pointer class with value semantics and no implicit copies.
+ *
+ * Moves are as cheap as for value_ptr; copies are made with clone(). It can
+ * be converted to and from value_ptr explicitly, which copies from an lvalue
+ * and moves from an rvalue.
+ */
+template <typename T>
+class explicit_value_ptr {
+public:
+  using pointer = T*;
+  using element_type = T;
+
+  template <typename U>
+  friend class explicit_value_ptr;
+
+  constexpr explicit_value_ptr() noexcept = default;
+
+  constexpr explicit_value_ptr(std::nullptr_t) noexcept {}
+
+  /**
+   * Construct from an underlying raw pointer, taking ownership of it.
+   */
+  template <typename U,
+      typename
+      = typename std::enable_if<std::is_convertible<U*, pointer>::value>::type>
+  explicit explicit_value_ptr(U* ptr)
+      : ptr_(ptr)
+  {
+  }
+
+  /**
+   * Construct an object of type D in place, forwarding args to its
+   * constructor.
+   */
+  template <typename D, typename... Args,
+      typename
+      = typename std::enable_if<std::is_convertible<D*, pointer>::value>::type>
+  explicit explicit_value_ptr(in_place_type_t<D> tag, Args&&... args)
+      : ptr_(tag, std::forward<Args>(args)...)
+  {
+  }
+
+  /**
+   * Take over the object managed by a value_ptr, without copying it.
+   */
+  template <typename U,
+      typename = typename std::enable_if<
+          std::is_convertible<typename value_ptr<U>::pointer,
+              pointer>::value>::type>
+  explicit explicit_value_ptr(value_ptr<U>&& other)
+      : ptr_(std::move(other))
+  {
+  }
+
+  /**
+   * Deep-copy the object managed by a value_ptr.
+   */
+  template <typename U,
+      typename = typename std::enable_if<
+          std::is_convertible<typename value_ptr<U>::pointer,
+              pointer>::value>::type>
+  explicit explicit_value_ptr(value_ptr<U> const& other)
+      : ptr_(other)
+  {
+  }
+
+  /**
+   * Take over the object managed by an explicit_value_ptr to a derived type.
+   */
+  template <typename U,
+      typename = typename std::enable_if<
+          std::is_convertible<typename value_ptr<U>::pointer,
+              pointer>::value>::type>
+  explicit_value_ptr(explicit_value_ptr<U>&& other)
+      : ptr_(std::move(other.ptr_))
+  {
+  }
+
+  explicit_value_ptr(explicit_value_ptr const&) = delete;
+  explicit_value_ptr& operator=(explicit_value_ptr const&) = delete;
+
+  explicit_value_ptr(explicit_value_ptr&&) noexcept = default;
+  explicit_value_ptr& operator=(explicit_value_ptr&&) noexcept = default;
+
+  /**
+   * Deep-copy the managed object, keeping its dynamic type.
+   */
+  explicit_value_ptr clone() const
+  {
+    return explicit_value_ptr(ptr_);
+  }
+
+  /**
+   * Deep-copy the managed object into a value_ptr.
+   */
+  explicit operator value_ptr<T>() const& { return ptr_; }
+
+  /**
+   * Move the managed object into a value_ptr, without copying it.
+   */
+  explicit operator value_ptr<T>() && { return std::move(ptr_); }
+
+  T& operator*() const noexcept { return *ptr_; }
+
+  T* operator->() const noexcept { return ptr_.operator->(); }
+
+  T* get() const noexcept { return ptr_.get(); }
+
+  explicit operator bool() const noexcept { return static_cast<bool>(ptr_); }
+
+  /**
+   * Get the underlying raw pointer and release ownership (see
+   * value_ptr::release).
+   */
+  T* release() { return ptr_.release(); }
+
+  std::unique_ptr<T> to_unique() { return ptr_.to_unique(); }
+
+  template <typename U>
+  void reset(U* ptr)
+  {
+    ptr_.reset(ptr);
+  }
+
+  void reset(std::nullptr_t = nullptr) noexcept { ptr_.reset(); }
+
+  template <typename D = T, typename... Args>
+  D& emplace(Args&&... args)
+  {
+    return ptr_.template emplace<D>(std::forward<Args>(args)...);
+  }
+
+  void swap(explicit_value_ptr& other) noexcept { ptr_.swap(other.ptr_); }
+
+  std::size_t deep_size() const { return ptr_.deep_size(); }
+
+private:
+  value_ptr<T> ptr_;
+};
+
+template <typename T>
+void swap(explicit_value_ptr<T>& a, explicit_value_ptr<T>& b) noexcept
+{
+  a.swap(b);
+}
+
+template <typename T1, typename T2>
+bool operator==(
+    explicit_value_ptr<T1> const& a, explicit_value_ptr<T2> const& b) noexcept
+{
+  return a.get() == b.get();
+}
+
+template <typename T1, typename T2>
+bool operator!=(
+    explicit_value_ptr<T1> const& a, explicit_value_ptr<T2> const& b) noexcept
+{
+  return !(a == b);
+}
+
+template <typename T>
+bool operator==(explicit_value_ptr<T> const& a, std::nullptr_t) noexcept
+{
+  return !a;
+}
+
+template <typename T>
+bool operator!=(explicit_value_ptr<T> const& a, std::nullptr_t) noexcept
+{
+  return static_cast<bool>(a);
+}
+
+template <typename T, typename... Args>
+explicit_value_ptr<T> make_explicit_val(Args&&... args)
+{
+  return explicit_value_ptr<T>(
+      in_place_type_t<T>{}, std::forward<Args>(args)...);
+}
+
+} // namespace bsc
+
+namespace std {
+
+template <typename T>
+struct hash<bsc::explicit_value_ptr<T>> {
+  std::size_t operator()(bsc::explicit_value_ptr<T> const& ptr) const
+  {
+    return std::hash<T*>()(ptr.get());
+  }
+};
+
+} // namespace std
@@ -0,0 +1,169 @@
+/**
+ * Pimpl storage inside the owning object, with value semantics.
+ *
+ * A value_ptr<Impl> member gives a class with a private implementation
+ * ("pimpl") copy semantics, but allocates the implementation on the heap for
+ * every object constructed or copied. fast_pimpl<Impl, Size, Align> stores it
+ * in a fixed-size buffer inside the owning object instead, while keeping the
+ * compilation firewall: Impl only has to be complete where a fast_pimpl is
+ * constructed from scratch, and the owning class's copy, move and destruction
+ * can still be defaulted in its header.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace bsc {
+
+namespace detail {
+
+/**
+ * Type-erased operations on the object in a fast_pimpl, which play the part
+ * of the virtual functions of a value_ptr model.
+ *
+ * The models themselves can't be reused here: they are heap objects that clone
+ * into new allocations, and embedding one would add a vtable pointer, a cached
+ * object pointer and a type descriptor to every owner. These operations work
+ * on storage the caller provides instead, for one pointer per object.
+ */
+struct pimpl_ops {
+  void (*copy)(void* dest, void const* src);
+  void (*move)(void* dest, void* src);
+  void (*copy_assign)(void* dest, void const* src);
+  void (*move_assign)(void* dest, void* src);
+  void (*destroy)(void* obj);
+};
+
+template <typename Impl>
+struct pimpl_ops_for {
+  static void copy(void* dest, void const* src)
+  {
+    ::new (dest) Impl(*static_cast<Impl const*>(src));
+  }
+
+  static void move(void* dest, void* src)
+  {
+    ::new (dest) Impl(std::move(*static_cast<Impl*>(src)));
+  }
+
+  static void copy_assign(void* dest, void const* src)
+  {
+    *static_cast<Impl*>(dest) = *static_cast<Impl const*>(src);
+  }
+
+  static void move_assign(void* dest, void* src)
+  {
+    *static_cast<Impl*>(dest) = std::move(*static_cast<Impl*>(src));
+  }
+
+  static void destroy(void* obj) { static_cast<Impl*>(obj)->~Impl(); }
+
+  static const pimpl_ops value;
+};
+
+template <typename Impl>
+const pimpl_ops pimpl_ops_for<Impl>::value = { &pimpl_ops_for<Impl>::copy,
+  &pimpl_ops_for<Impl>::move, &pimpl_ops_for<Impl>::copy_assign,
+  &pimpl_ops_for<Impl>::move_assign, &pimpl_ops_for<Impl>::destroy };
+
+} // namespace detail
+
+/**
+ * Storage for an object of type Impl, of at most Size bytes and alignment
+ * Align, inside the object that owns it.
+ *
+ * Copying a fast_pimpl copies the Impl (with its copy constructor or copy
+ * assignment operator), and moving it moves the Impl, leaving the source
+ * holding a moved-from Impl; there is no empty state. Constness propagates,
+ * so a const fast_pimpl only gives access to a const Impl.
+ *
+ * The constructors check that Impl fits, and that it can be moved and move
+ * assigned without throwing, so that owners can be moved cheaply in
+ * containers. An Impl that outgrows its storage is a compile error in the
+ * file that defines it. Copies, moves and the destructor go through a table of
+ * functions recorded at construction (one pointer per object), which is what
+ * lets them be used where Impl is incomplete.
+ */
+template <typename Impl, std::size_t Size,
+    std::size_t Align = alignof(std::max_align_t)>
+class fast_pimpl {
+public:
+  /**
+   * Construct a value-initialized Impl.
+   */
+  fast_pimpl()
+      : fast_pimpl(in_place_type_t<Impl>{})
+  {
+  }
+
+  /**
+   * Construct an Impl in place, forwarding args to its constructor.
+   */
+  template <typename... Args>
+  explicit fast_pimpl(in_place_type_t<Impl>, Args&&... args)
+      : ops_(&detail::pimpl_ops_for<Impl>::value)
+  {
+    static_assert(sizeof(Impl) <= Size,
+        "Impl is too large for this fast_pimpl; increase its Size");
+    static_assert(alignof(Impl) <= Align,
+        "Impl is over-aligned for this fast_pimpl; increase its Align");
+    static_assert(std::is_nothrow_move_constructible<Impl>::value,
+        "fast_pimpl requires Impl to have a noexcept move constructor");
+    static_assert(std::is_nothrow_move_assignable<Impl>::value,
+        "fast_pimpl requires Impl to have a noexcept move assignment");
+
+    ::new (storage_) Impl(std::forward<Args>(args)...);
+  }
+
+  fast_pimpl(fast_pimpl const& other)
+      : ops_(other.ops_)
+  {
+    ops_->copy(storage_, other.storage_);
+  }
+
+  fast_pimpl(fast_pimpl&& other) noexcept
+      : ops_(other.ops_)
+  {
+    ops_->move(storage_, other.storage_);
+  }
+
+  fast_pimpl& operator=(fast_pimpl const& other)
+  {
+    ops_->copy_assign(storage_, other.storage_);
+    return *this;
+  }
+
+  fast_pimpl& operator=(fast_pimpl&& other) noexcept
+  {
+    ops_->move_assign(storage_, other.storage_);
+    return *this;
+  }
+
+  ~fast_pimpl() { ops_->destroy(storage_); }
+
+  Impl* get() noexcept { return reinterpret_cast<Impl*>(storage_); }
+
+  Impl const* get() const noexcept
+  {
+    return reinterpret_cast<Impl const*>(storage_);
+  }
+
+  Impl& operator*() noexcept { return *get(); }
+
+  Impl const& operator*() const noexcept { return *get(); }
+
+  Impl* operator->() noexcept { return get(); }
+
+  Impl const* operator->() const noexcept { return get(); }
+
+private:
+  detail::pimpl_ops const* ops_;
+  alignas(Align) unsigned char storage_[Size];
+};
+
+} // namespace bsc
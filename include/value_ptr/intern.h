@@ -0,0 +1,217 @@
+/**
+ * Interning (hash-consing) of immutable value_ptr payloads.
+ *
+ * Programs that build many structurally identical objects (expression trees,
+ * for example) can keep a single canonical copy of each distinct value in an
+ * intern_pool, and refer to it through frozen_value_ptr handles. Copying a
+ * handle copies a pointer rather than cloning the object, and memory shrinks
+ * with the ratio of duplicates.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace bsc {
+
+template <typename T, typename Hash, typename Equal>
+class intern_pool;
+
+/**
+ * Handle to the canonical, immutable instance of a value held by an
+ * intern_pool.
+ *
+ * A handle is the size of a pointer and does not own its object; the pool
+ * does, and must outlive every handle it returns. Two handles from the same
+ * pool compare equal exactly when their values do, so comparison and hashing
+ * only look at the pointer.
+ */
+template <typename T>
+class frozen_value_ptr {
+public:
+  using pointer = T const*;
+  using element_type = T const;
+
+  /**
+   * Construct a null handle.
+   */
+  frozen_value_ptr() noexcept = default;
+
+  T const& operator*() const noexcept { return *ptr_; }
+
+  T const* operator->() const noexcept { return ptr_; }
+
+  T const* get() const noexcept { return ptr_; }
+
+  explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+  friend bool operator==(frozen_value_ptr a, frozen_value_ptr b) noexcept
+  {
+    return a.ptr_ == b.ptr_;
+  }
+
+  friend bool operator!=(frozen_value_ptr a, frozen_value_ptr b) noexcept
+  {
+    return a.ptr_ != b.ptr_;
+  }
+
+private:
+  template <typename U, typename Hash, typename Equal>
+  friend class intern_pool;
+
+  explicit frozen_value_ptr(T const* ptr) noexcept
+      : ptr_(ptr)
+  {
+  }
+
+  T const* ptr_ = nullptr;
+};
+
+/**
+ * A set of canonical values of (static) type T.
+ *
+ * Two values are the same if they have the same dynamic type and Equal says
+ * they are equal; Hash must be consistent with Equal. Both are applied to the
+ * objects as T const&, so for a class hierarchy they will usually call virtual
+ * members. Hashing and comparing need only be shallow if the objects refer to
+ * their parts through frozen_value_ptrs from the same pool, since equal parts
+ * are then the same pointer.
+ *
+ * Interning is thread-safe. Handles stay valid until the pool is cleared or
+ * destroyed.
+ */
+template <typename T, typename Hash = std::hash<T>,
+    typename Equal = std::equal_to<T>>
+class intern_pool {
+public:
+  explicit intern_pool(Hash hash = Hash(), Equal equal = Equal())
+      : values_(0, entry_hash{}, entry_equal{ std::move(equal) })
+      , hash_(std::move(hash))
+  {
+  }
+
+  intern_pool(intern_pool const&) = delete;
+  intern_pool& operator=(intern_pool const&) = delete;
+
+  /**
+   * Get a handle to the canonical instance of the value managed by ptr,
+   * taking ownership of it if it is the first such value. A null ptr gives a
+   * null handle.
+   */
+  frozen_value_ptr<T> intern(value_ptr<T>&& ptr)
+  {
+    if (!ptr) {
+      return {};
+    }
+
+    auto key = make_key(ptr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = values_.find(key);
+    if (found != values_.end()) {
+      return frozen_value_ptr<T>(found->object);
+    }
+
+    // Moving a value_ptr doesn't move its object, so key.object stays valid.
+    key.owner = std::move(ptr);
+    values_.insert(std::move(key));
+    return frozen_value_ptr<T>(key.object);
+  }
+
+  /**
+   * Get a handle to the canonical instance of the value managed by ptr,
+   * copying it into the pool if it is the first such value.
+   */
+  frozen_value_ptr<T> intern(value_ptr<T> const& ptr)
+  {
+    if (!ptr) {
+      return {};
+    }
+
+    auto key = make_key(ptr);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = values_.find(key);
+      if (found != values_.end()) {
+        return frozen_value_ptr<T>(found->object);
+      }
+    }
+
+    // Copy outside the lock; another thread may intern the same value first.
+    return intern(value_ptr<T>(ptr));
+  }
+
+  /**
+   * The number of distinct values in the pool.
+   */
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return values_.size();
+  }
+
+  /**
+   * Destroy every value in the pool, invalidating all handles to them.
+   */
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.clear();
+  }
+
+private:
+  struct entry {
+    std::size_t hash;
+    detail::type_descriptor const* type;
+    T const* object;
+
+    // Null for lookup keys, which refer to an object owned elsewhere.
+    value_ptr<T> owner;
+  };
+
+  struct entry_hash {
+    std::size_t operator()(entry const& e) const noexcept
+    {
+      return e.hash ^ std::hash<void const*>()(e.type);
+    }
+  };
+
+  struct entry_equal {
+    bool operator()(entry const& a, entry const& b) const
+    {
+      return a.type == b.type && a.hash == b.hash
+          && equal(*a.object, *b.object);
+    }
+
+    Equal equal;
+  };
+
+  entry make_key(value_ptr<T> const& ptr) const
+  {
+    return entry{ hash_(*ptr), detail::access::dynamic_type(ptr), ptr.get(),
+      value_ptr<T>() };
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_set<entry, entry_hash, entry_equal> values_;
+  Hash hash_;
+};
+
+} // namespace bsc
+
+namespace std {
+
+template <typename T>
+struct hash<bsc::frozen_value_ptr<T>> {
+  std::size_t operator()(bsc::frozen_value_ptr<T> const& ptr) const
+  {
+    return std::hash<T const*>()(ptr.get());
+  }
+};
+
+} // namespace std
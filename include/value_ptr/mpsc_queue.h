@@ -0,0 +1,129 @@
+/**
+ * An intrusive multi-producer, single-consumer queue of value_ptrs.
+ *
+ * Passing value_ptrs through an ordinary concurrent queue allocates a queue
+ * node for every message, on top of the allocation holding the message itself.
+ * For types that enable_queue_hook, the bookkeeping allocated with each object
+ * already contains a link, so mpsc_queue chains the value_ptrs' own
+ * allocations together and hands messages over without allocating.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <atomic>
+
+namespace bsc {
+
+/**
+ * Lock-free queue of value_ptr<T>s that may be pushed to by any number of
+ * threads and popped from by one thread at a time.
+ *
+ * This is Dmitry Vyukov's intrusive MPSC queue. Pushing is wait-free: one
+ * atomic exchange and one store. Popping is lock-free, but may find the queue
+ * momentarily empty while a producer is between those two steps, even though
+ * that producer's push has started; the message is popped on a later call.
+ *
+ * T must specialize enable_queue_hook.
+ */
+template <typename T>
+class mpsc_queue {
+  static_assert(enable_queue_hook<T>::value,
+      "mpsc_queue<T> requires enable_queue_hook<T> to be specialized");
+
+public:
+  mpsc_queue() noexcept
+      : head_(&stub_)
+      , tail_(&stub_)
+  {
+  }
+
+  mpsc_queue(mpsc_queue const&) = delete;
+  mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+  /**
+   * Destroys any messages still in the queue, which must not be in use by
+   * any other thread.
+   */
+  ~mpsc_queue()
+  {
+    while (pop()) {
+    }
+  }
+
+  /**
+   * Take ownership of the object managed by ptr and append it to the queue.
+   * After calling, ptr is null. Pushing a null ptr does nothing.
+   */
+  void push(value_ptr<T>&& ptr) noexcept
+  {
+    if (ptr) {
+      push(detail::access::release_hook(ptr));
+    }
+  }
+
+  /**
+   * Remove the message at the front of the queue, returning a null value_ptr
+   * if there isn't one. Only one thread may pop at a time.
+   */
+  value_ptr<T> pop() noexcept
+  {
+    auto tail = tail_;
+    auto next = tail->queue_next.load(std::memory_order_acquire);
+
+    if (tail == &stub_) {
+      if (!next) {
+        return {};
+      }
+
+      tail_ = next;
+      tail = next;
+      next = next->queue_next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+      tail_ = next;
+      return detail::access::adopt_hook<T>(tail);
+    }
+
+    // tail is the last node pushed, unless another push is in progress.
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return {};
+    }
+
+    // Push the stub behind tail, so that tail can be unlinked.
+    push(&stub_);
+
+    next = tail->queue_next.load(std::memory_order_acquire);
+    if (next) {
+      tail_ = next;
+      return detail::access::adopt_hook<T>(tail);
+    }
+
+    return {};
+  }
+
+  /**
+   * Whether the queue is empty, as seen by the consumer thread. Messages
+   * being pushed concurrently may or may not be seen.
+   */
+  bool empty() const noexcept
+  {
+    return tail_ == &stub_
+        && !stub_.queue_next.load(std::memory_order_acquire);
+  }
+
+private:
+  void push(detail::queue_hook* node) noexcept
+  {
+    node->queue_next.store(nullptr, std::memory_order_relaxed);
+    auto prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->queue_next.store(node, std::memory_order_release);
+  }
+
+  std::atomic<detail::queue_hook*> head_;
+  detail::queue_hook* tail_;
+  detail::queue_hook stub_;
+};
+
+} // namespace bsc
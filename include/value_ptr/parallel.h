@@ -0,0 +1,192 @@
+/**
+ * Parallel deep copying of ranges of value_ptr.
+ *
+ * Copying a value_ptr clones the object it manages, so copying a large
+ * container of them is dominated by one allocation and one copy constructor
+ * call per element. These are independent of each other, which means the work
+ * can be split across threads without any synchronisation beyond joining the
+ * workers at the end.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<execution>)
+#include <execution>
+#endif
+#endif
+
+namespace bsc {
+
+namespace detail {
+
+/**
+ * Ranges smaller than this are copied on the calling thread; spawning a worker
+ * costs more than cloning a few thousand small objects.
+ */
+constexpr std::size_t parallel_copy_min_chunk = 4096;
+
+/**
+ * Starts the workers for parallel_deep_copy.
+ */
+struct thread_launcher {
+  template <typename F>
+  std::thread operator()(F& f, unsigned i) const
+  {
+    return std::thread(f, i);
+  }
+};
+
+/**
+ * Implements parallel_deep_copy, starting each worker with launch(f, i).
+ */
+template <typename InputIt, typename OutputIt, typename Launcher>
+OutputIt parallel_deep_copy(InputIt first, InputIt last, OutputIt out,
+    unsigned threads, Launcher launch)
+{
+  static_assert(
+      std::is_base_of<std::random_access_iterator_tag,
+          typename std::iterator_traits<InputIt>::iterator_category>::value,
+      "parallel_deep_copy requires random access input iterators");
+
+  auto const size = static_cast<std::size_t>(std::distance(first, last));
+
+  if (threads == 0) {
+    threads = 1;
+  }
+
+  auto const max_threads = size / parallel_copy_min_chunk;
+  if (threads > max_threads) {
+    threads = static_cast<unsigned>(max_threads);
+  }
+
+  if (threads <= 1) {
+    return std::copy(first, last, out);
+  }
+
+#if VP_HAS_EXCEPTIONS
+  auto errors = std::vector<std::exception_ptr>(threads);
+#endif
+  auto workers = std::vector<std::thread>{};
+  workers.reserve(threads - 1);
+
+  auto const chunk = size / threads;
+  auto const copy_chunk = [&](unsigned i) {
+    auto const begin = i * chunk;
+    auto const end = (i == threads - 1) ? size : begin + chunk;
+
+#if VP_HAS_EXCEPTIONS
+    try {
+      std::copy(first + begin, first + end, out + begin);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+#else
+    std::copy(first + begin, first + end, out + begin);
+#endif
+  };
+
+  auto started = 1u;
+
+  VP_TRY
+  {
+    for (; started < threads; ++started) {
+      workers.push_back(launch(copy_chunk, started));
+    }
+  }
+  VP_CATCH_ALL
+  {
+    // Out of threads (e.g. std::system_error with EAGAIN); the chunks that
+    // weren't handed out are copied below.
+  }
+
+  // The calling thread takes the first chunk rather than sitting idle.
+  copy_chunk(0);
+
+  for (auto i = started; i < threads; ++i) {
+    copy_chunk(i);
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+#if VP_HAS_EXCEPTIONS
+  for (auto const& err : errors) {
+    if (err) {
+      std::rethrow_exception(err);
+    }
+  }
+#endif
+
+  return out + size;
+}
+
+} // namespace detail
+
+/**
+ * Deep-copy the range [first, last) into the range beginning at out, using up
+ * to threads worker threads.
+ *
+ * The output range must already contain last - first elements, which are
+ * assigned to (e.g. a vector that has been resized). Both ranges must be
+ * random access so that they can be split into contiguous chunks.
+ *
+ * Each worker clones its own chunk, so the new objects are allocated from the
+ * worker's thread rather than from the caller's. With a thread-caching
+ * allocator (including glibc malloc's per-thread arenas) this means workers do
+ * not contend on a single allocator lock.
+ *
+ * If any element copy throws, the first exception is rethrown on the calling
+ * thread after all workers have finished. Elements of the output range may
+ * have been partially assigned in that case. If a worker thread can't be
+ * started, the calling thread copies its chunk instead.
+ *
+ * Returns an iterator one past the last element written.
+ */
+template <typename InputIt, typename OutputIt>
+OutputIt parallel_deep_copy(
+    InputIt first, InputIt last, OutputIt out, unsigned threads)
+{
+  return detail::parallel_deep_copy(
+      first, last, out, threads, detail::thread_launcher{});
+}
+
+/**
+ * Deep-copy the range [first, last) into the range beginning at out, using one
+ * thread per hardware thread.
+ */
+template <typename InputIt, typename OutputIt>
+OutputIt parallel_deep_copy(InputIt first, InputIt last, OutputIt out)
+{
+  auto threads = std::thread::hardware_concurrency();
+  return parallel_deep_copy(first, last, out, threads ? threads : 1);
+}
+
+#if defined(__cpp_lib_execution) && __cpp_lib_execution >= 201603L
+/**
+ * Deep-copy the range [first, last) into the range beginning at out using a
+ * standard execution policy (e.g. std::execution::par).
+ *
+ * How the work is scheduled, and whether it is parallel at all, is up to the
+ * standard library's implementation of the policy.
+ */
+template <typename ExecutionPolicy, typename InputIt, typename OutputIt,
+    typename = typename std::enable_if<std::is_execution_policy<
+        typename std::decay<ExecutionPolicy>::type>::value>::type>
+OutputIt parallel_deep_copy(
+    ExecutionPolicy&& policy, InputIt first, InputIt last, OutputIt out)
+{
+  return std::copy(std::forward<ExecutionPolicy>(policy), first, last, out);
+}
+#endif
+
+} // namespace bsc
@@ -0,0 +1,369 @@
+/**
+ * Compact 32-bit handles to values stored densely in a slot map.
+ *
+ * A value_ptr is the size of a pointer, and each object it manages lives in a
+ * heap block of its own. Where there are very many references, e.g. in column
+ * stores, pooled_value_ptr halves the size of the reference by storing a
+ * 32-bit index into a per-type pool instead, and the pool keeps the objects
+ * contiguous so that scanning all of them is a sequential pass over memory.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bsc {
+
+namespace detail {
+
+/**
+ * Make room for one more element in v, growing it geometrically (reserve
+ * alone may grow it by exactly one).
+ */
+template <typename Vector>
+void reserve_one_more(Vector& v)
+{
+  if (v.size() == v.capacity()) {
+    v.reserve(v.empty() ? 8 : 2 * v.size());
+  }
+}
+
+} // namespace detail
+
+/**
+ * A slot map holding objects of type T, addressed by 32-bit handles.
+ *
+ * The objects are stored contiguously, in no particular order; erasing one
+ * moves the last object into its place. A handle is an index into a table of
+ * slots, which records where its object currently is, together with a
+ * generation of GenerationBits bits (leaving 32 - GenerationBits for the
+ * index) that is advanced whenever the slot is freed. Handles to erased
+ * objects therefore don't find objects that later reuse the slot, until the
+ * generation wraps around.
+ *
+ * Handles are only meaningful to the pool that issued them. Each combination
+ * of T, Tag and GenerationBits has one pool, returned by instance(), which is
+ * what lets pooled_value_ptr refer to objects with a bare handle; different
+ * Tags give independent pools of the same type.
+ *
+ * Pools are not thread-safe. Inserting or erasing objects invalidates
+ * pointers and references to all of them, but not handles.
+ */
+template <typename T, typename Tag = void, unsigned GenerationBits = 8>
+class value_pool {
+  static_assert(GenerationBits < 32, "handles need at least one index bit");
+
+public:
+  using handle_type = std::uint32_t;
+
+  /**
+   * The number of bits of a handle used for the slot index.
+   */
+  static constexpr unsigned index_bits = 32 - GenerationBits;
+
+  /**
+   * The pool for this combination of template arguments.
+   */
+  static value_pool& instance()
+  {
+    static value_pool pool;
+    return pool;
+  }
+
+  value_pool() = default;
+
+  value_pool(value_pool const&) = delete;
+  value_pool& operator=(value_pool const&) = delete;
+
+  /**
+   * Construct an object from args, returning its handle. Throws
+   * std::length_error if every slot is in use.
+   */
+  template <typename... Args>
+  handle_type emplace(Args&&... args)
+  {
+    auto const index = reserve_slot();
+    values_.emplace_back(std::forward<Args>(args)...);
+    return commit_slot(index);
+  }
+
+  /**
+   * Copy the object with the given (valid) handle, returning the copy's
+   * handle.
+   */
+  handle_type clone(handle_type handle)
+  {
+    auto const index = reserve_slot();
+
+    // Reserving first keeps the source in place while it is copied.
+    detail::reserve_one_more(values_);
+    values_.push_back(values_[slots_[slot_index(handle)].dense]);
+    return commit_slot(index);
+  }
+
+  /**
+   * Destroy the object with the given handle, if it is still valid. The last
+   * object is moved into its place, so T's move assignment must not throw.
+   */
+  void erase(handle_type handle) noexcept
+  {
+    static_assert(std::is_nothrow_move_assignable<T>::value,
+        "value_pool requires T to have a noexcept move assignment");
+
+    if (!contains(handle)) {
+      return;
+    }
+
+    auto const index = slot_index(handle);
+    auto& slot = slots_[index];
+    auto const dense = slot.dense;
+
+    if (dense + 1 != values_.size()) {
+      values_[dense] = std::move(values_.back());
+      owners_[dense] = owners_.back();
+      slots_[owners_[dense]].dense = dense;
+    }
+
+    values_.pop_back();
+    owners_.pop_back();
+
+    slot.generation = (slot.generation + 1) & generation_mask;
+    slot.dense = free_;
+    free_ = index;
+  }
+
+  /**
+   * Whether handle refers to an object in this pool.
+   */
+  bool contains(handle_type handle) const noexcept
+  {
+    if (handle == 0) {
+      return false;
+    }
+
+    auto const index = slot_index(handle);
+    return index < slots_.size() && owners_.size() > slots_[index].dense
+        && owners_[slots_[index].dense] == index
+        && slots_[index].generation == generation(handle);
+  }
+
+  /**
+   * The object with the given handle, or null if it is not valid.
+   */
+  T* get(handle_type handle) noexcept
+  {
+    return contains(handle) ? &values_[slots_[slot_index(handle)].dense]
+                            : nullptr;
+  }
+
+  T const* get(handle_type handle) const noexcept
+  {
+    return contains(handle) ? &values_[slots_[slot_index(handle)].dense]
+                            : nullptr;
+  }
+
+  /**
+   * The number of objects in the pool.
+   */
+  std::size_t size() const noexcept { return values_.size(); }
+
+  /**
+   * Iterators over the objects in the pool, which are contiguous.
+   */
+  T* begin() noexcept { return values_.data(); }
+  T* end() noexcept { return values_.data() + values_.size(); }
+  T const* begin() const noexcept { return values_.data(); }
+  T const* end() const noexcept { return values_.data() + values_.size(); }
+
+private:
+  static constexpr std::uint64_t index_mask
+      = (std::uint64_t(1) << index_bits) - 1;
+  static constexpr std::uint32_t generation_mask
+      = static_cast<std::uint32_t>((std::uint64_t(1) << GenerationBits) - 1);
+  static constexpr std::uint32_t no_slot = ~std::uint32_t(0);
+
+  // dense is the position of the slot's object in values_, or the next free
+  // slot if the slot is free.
+  struct slot {
+    std::uint32_t dense;
+    std::uint32_t generation;
+  };
+
+  // Handles store the index plus one, so that zero is never a valid handle.
+  static std::uint32_t slot_index(handle_type handle) noexcept
+  {
+    return static_cast<std::uint32_t>((handle & index_mask) - 1);
+  }
+
+  static std::uint32_t generation(handle_type handle) noexcept
+  {
+    return static_cast<std::uint32_t>(std::uint64_t(handle) >> index_bits);
+  }
+
+  /**
+   * Find a slot for a new object and make room to record it, so that nothing
+   * can throw after the object has been added.
+   */
+  std::uint32_t reserve_slot()
+  {
+    detail::reserve_one_more(owners_);
+
+    if (free_ != no_slot) {
+      return free_;
+    }
+
+    // The largest index leaves room for the + 1 in handles.
+    if (slots_.size() >= index_mask) {
+      VP_THROW(std::length_error("value_pool is full"));
+    }
+
+    detail::reserve_one_more(slots_);
+    return static_cast<std::uint32_t>(slots_.size());
+  }
+
+  handle_type commit_slot(std::uint32_t index) noexcept
+  {
+    if (index == slots_.size()) {
+      slots_.push_back({ 0, 0 });
+    } else {
+      free_ = slots_[index].dense;
+    }
+
+    auto& slot = slots_[index];
+    slot.dense = static_cast<std::uint32_t>(values_.size() - 1);
+    owners_.push_back(index);
+
+    return static_cast<handle_type>(
+        (std::uint64_t(slot.generation) << index_bits) | (index + 1));
+  }
+
+  std::vector<T> values_;
+  std::vector<std::uint32_t> owners_;
+  std::vector<slot> slots_;
+  std::uint32_t free_ = no_slot;
+};
+
+template <typename T, typename Tag, unsigned GenerationBits>
+constexpr unsigned value_pool<T, Tag, GenerationBits>::index_bits;
+
+template <typename T, typename Tag, unsigned GenerationBits>
+constexpr std::uint64_t value_pool<T, Tag, GenerationBits>::index_mask;
+
+template <typename T, typename Tag, unsigned GenerationBits>
+constexpr std::uint32_t value_pool<T, Tag, GenerationBits>::generation_mask;
+
+template <typename T, typename Tag, unsigned GenerationBits>
+constexpr std::uint32_t value_pool<T, Tag, GenerationBits>::no_slot;
+
+/**
+ * Smart pointer with value semantics whose object lives in
+ * value_pool<T, Tag, GenerationBits>::instance(), and which is itself only
+ * a 32-bit handle.
+ *
+ * Copying a pooled_value_ptr copies the object into a new slot, and
+ * destroying it erases the object. Objects are stored as exactly T, so unlike
+ * value_ptr this does not hold objects of derived types (a pool of
+ * value_ptr<Base> can, at the cost of an extra indirection). The pool is not
+ * thread-safe, so neither are pooled_value_ptrs that share it.
+ */
+template <typename T, typename Tag = void, unsigned GenerationBits = 8>
+class pooled_value_ptr {
+public:
+  using pool_type = value_pool<T, Tag, GenerationBits>;
+  using handle_type = typename pool_type::handle_type;
+  using pointer = T*;
+  using element_type = T;
+
+  constexpr pooled_value_ptr() noexcept = default;
+
+  constexpr pooled_value_ptr(std::nullptr_t) noexcept {}
+
+  /**
+   * Construct an object in the pool, forwarding args to its constructor.
+   */
+  template <typename... Args>
+  explicit pooled_value_ptr(in_place_type_t<T>, Args&&... args)
+      : handle_(pool_type::instance().emplace(std::forward<Args>(args)...))
+  {
+  }
+
+  pooled_value_ptr(pooled_value_ptr const& other)
+      : handle_(other ? pool_type::instance().clone(other.handle_) : 0)
+  {
+  }
+
+  pooled_value_ptr(pooled_value_ptr&& other) noexcept
+      : handle_(other.handle_)
+  {
+    other.handle_ = 0;
+  }
+
+  pooled_value_ptr& operator=(pooled_value_ptr const& other)
+  {
+    pooled_value_ptr(other).swap(*this);
+    return *this;
+  }
+
+  pooled_value_ptr& operator=(pooled_value_ptr&& other) noexcept
+  {
+    pooled_value_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~pooled_value_ptr() { reset(); }
+
+  /**
+   * Get the object. The pointer is invalidated by any insertion into or
+   * erasure from the pool.
+   */
+  T* get() const noexcept { return pool_type::instance().get(handle_); }
+
+  T& operator*() const noexcept { return *get(); }
+
+  T* operator->() const noexcept { return get(); }
+
+  explicit operator bool() const noexcept { return handle_ != 0; }
+
+  /**
+   * The handle identifying the object in the pool.
+   */
+  handle_type handle() const noexcept { return handle_; }
+
+  void reset() noexcept
+  {
+    if (handle_) {
+      pool_type::instance().erase(handle_);
+      handle_ = 0;
+    }
+  }
+
+  void swap(pooled_value_ptr& other) noexcept
+  {
+    std::swap(handle_, other.handle_);
+  }
+
+private:
+  handle_type handle_ = 0;
+};
+
+template <typename T, typename Tag, unsigned GenerationBits>
+void swap(pooled_value_ptr<T, Tag, GenerationBits>& a,
+    pooled_value_ptr<T, Tag, GenerationBits>& b) noexcept
+{
+  a.swap(b);
+}
+
+template <typename T, typename... Args>
+pooled_value_ptr<T> make_pooled_val(Args&&... args)
+{
+  return pooled_value_ptr<T>(
+      in_place_type_t<T>{}, std::forward<Args>(args)...);
+}
+
+} // namespace bsc
@@ -0,0 +1,211 @@
+/**
+ * Deferred destruction of value_ptr payloads.
+ *
+ * Destroying a value_ptr runs the destructor of everything it owns, inline on
+ * the destroying thread. For large objects on latency-sensitive threads this
+ * is undesirable; retiring a value_ptr instead moves its model onto a queue to
+ * be destroyed later, in a batch or on a background thread.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bsc {
+
+/**
+ * A queue of retired value_ptr payloads waiting to be destroyed.
+ *
+ * Retiring and reclaiming are thread-safe. Payloads are destroyed outside the
+ * queue's lock, so retiring never waits for a running reclaim to finish
+ * destroying objects.
+ */
+class retire_queue {
+public:
+  retire_queue() = default;
+
+  retire_queue(retire_queue const&) = delete;
+  retire_queue& operator=(retire_queue const&) = delete;
+
+  /**
+   * Destroys anything still waiting in the queue.
+   */
+  ~retire_queue() { reclaim(); }
+
+  /**
+   * Take ownership of the object managed by ptr, to be destroyed by a later
+   * call to reclaim. After calling, ptr is null.
+   *
+   * Retiring does not allocate unless the queue needs to grow.
+   */
+  template <typename T>
+  void retire(value_ptr<T>&& ptr)
+  {
+    if (!ptr) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Make room first so that ptr keeps ownership if growing the queue throws.
+    retired_.push_back(nullptr);
+    retired_.back() = detail::access::release_model(ptr);
+  }
+
+  /**
+   * Destroy every payload retired so far, returning how many were destroyed.
+   */
+  std::size_t reclaim() noexcept
+  {
+    auto batch = std::vector<detail::model_base*>{};
+
+    // Retiring carries on into the spare buffer, which has the capacity of an
+    // earlier batch, while this one is destroyed.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batch.swap(retired_);
+      retired_.swap(spare_);
+    }
+
+    for (auto model : batch) {
+      detail::destroy_iteratively(model);
+    }
+
+    auto const count = batch.size();
+    batch.clear();
+
+    // Keep the batch's buffer for the next reclaim, unless a concurrent one
+    // has already returned a larger one.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (batch.capacity() > spare_.capacity()) {
+        spare_.swap(batch);
+      }
+    }
+
+    return count;
+  }
+
+  /**
+   * The number of payloads waiting to be destroyed.
+   */
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retired_.size();
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<detail::model_base*> retired_;
+  std::vector<detail::model_base*> spare_;
+};
+
+/**
+ * The process-wide retire queue. Anything left in it is destroyed at exit.
+ */
+inline retire_queue& global_retire_queue()
+{
+  static retire_queue queue;
+  return queue;
+}
+
+/**
+ * A retire queue owned by the calling thread. Anything left in it is destroyed
+ * when the thread exits.
+ */
+inline retire_queue& thread_retire_queue()
+{
+  static thread_local retire_queue queue;
+  return queue;
+}
+
+/**
+ * Retire ptr onto queue (by default the global queue) instead of destroying
+ * its payload immediately.
+ */
+template <typename T>
+void retire(value_ptr<T>&& ptr, retire_queue& queue = global_retire_queue())
+{
+  queue.retire(std::move(ptr));
+}
+
+/**
+ * Reclaims a retire queue periodically on a background thread.
+ *
+ * The queue must outlive the reaper. When the reaper is destroyed, its thread
+ * is stopped and the queue is reclaimed one final time.
+ */
+class background_reaper {
+public:
+  explicit background_reaper(retire_queue& queue,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(10))
+      : queue_(queue)
+      , interval_(interval)
+      , stop_(false)
+      , wake_(false)
+      , thread_([this] { run(); })
+  {
+  }
+
+  background_reaper(background_reaper const&) = delete;
+  background_reaper& operator=(background_reaper const&) = delete;
+
+  ~background_reaper()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+
+    cv_.notify_one();
+    thread_.join();
+    queue_.reclaim();
+  }
+
+  /**
+   * Ask the reaper to reclaim the queue now rather than at the end of the
+   * current interval.
+   */
+  void wake()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake_ = true;
+    }
+
+    cv_.notify_one();
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stop_) {
+      cv_.wait_for(lock, interval_, [this] { return stop_ || wake_; });
+      wake_ = false;
+
+      lock.unlock();
+      queue_.reclaim();
+      lock.lock();
+    }
+  }
+
+  retire_queue& queue_;
+  std::chrono::milliseconds interval_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+  bool wake_;
+
+  std::thread thread_;
+};
+
+} // namespace bsc
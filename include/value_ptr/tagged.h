@@ -0,0 +1,272 @@
+/**
+ * A value_ptr for closed hierarchies, with the dynamic type in the pointer.
+ *
+ * value_ptr supports any derived type by allocating a model alongside each
+ * object and copying and destroying it through the model's virtual functions.
+ * When the derived types are few and known in advance, the one among them
+ * that an object has fits in the low bits of a pointer to it, which are
+ * always zero because of its alignment. tagged_value_ptr stores the object
+ * alone and keeps that tag in the pointer instead, dispatching copies and
+ * destruction through a table indexed by the tag.
+ */
+#pragma once
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace bsc {
+
+namespace detail {
+
+/**
+ * The index of D in Ds, or sizeof...(Ds) if it isn't there.
+ */
+template <typename D, typename... Ds>
+struct tag_of;
+
+template <typename D>
+struct tag_of<D> : std::integral_constant<std::size_t, 0> {
+};
+
+template <typename D, typename... Ds>
+struct tag_of<D, D, Ds...> : std::integral_constant<std::size_t, 0> {
+};
+
+template <typename D, typename D0, typename... Ds>
+struct tag_of<D, D0, Ds...>
+    : std::integral_constant<std::size_t, 1 + tag_of<D, Ds...>::value> {
+};
+
+/**
+ * How to copy and destroy objects with one tag of a tagged_value_ptr<Base>.
+ */
+template <typename Base>
+struct tagged_ops {
+  Base* (*clone)(Base const* obj);
+  void (*destroy)(Base* obj);
+};
+
+template <typename Base, typename D>
+struct tagged_ops_for {
+  template <typename... Args>
+  static D* create(Args&&... args)
+  {
+    auto memory = allocate(sizeof(D), alignof(D));
+    VP_TRY
+    {
+      return ::new (memory) D(std::forward<Args>(args)...);
+    }
+    VP_CATCH_ALL
+    {
+      deallocate(memory, alignof(D));
+      VP_RETHROW;
+    }
+    return nullptr;
+  }
+
+  static Base* clone(Base const* obj)
+  {
+    return create(static_cast<D const&>(*obj));
+  }
+
+  static void destroy(Base* obj)
+  {
+    auto derived = static_cast<D*>(obj);
+    derived->~D();
+    deallocate(derived, alignof(D));
+  }
+};
+
+template <typename Base, typename... Ds>
+struct tagged_table {
+  static const tagged_ops<Base> value[sizeof...(Ds)];
+};
+
+template <typename Base, typename... Ds>
+const tagged_ops<Base> tagged_table<Base, Ds...>::value[sizeof...(Ds)]
+    = { { &tagged_ops_for<Base, Ds>::clone,
+        &tagged_ops_for<Base, Ds>::destroy }... };
+
+} // namespace detail
+
+/**
+ * Smart pointer with value semantics for objects of exactly one of the types
+ * Ds, each of which is Base or derived from it, stored as one pointer-sized
+ * word.
+ *
+ * The number of types must fit in the low bits that alignof(Base) leaves
+ * free, e.g. 8 types for a Base with a pointer or a vtable on a 64-bit
+ * system. Copies are made with the copy constructor of the object's type,
+ * and objects are destroyed with its destructor, so Base needs no virtual
+ * functions; but each D must derive from Base non-virtually, and an object
+ * must be created as one of the Ds (not as a type derived from one).
+ */
+template <typename Base, typename... Ds>
+class tagged_value_ptr {
+  static_assert(sizeof...(Ds) > 0, "tagged_value_ptr needs at least one type");
+  static_assert(sizeof...(Ds) <= alignof(Base),
+      "the alignment of Base leaves too few bits for this many types");
+
+  static constexpr std::uintptr_t tag_mask = alignof(Base) - 1;
+
+public:
+  using pointer = Base*;
+  using element_type = Base;
+
+  constexpr tagged_value_ptr() noexcept = default;
+
+  constexpr tagged_value_ptr(std::nullptr_t) noexcept {}
+
+  /**
+   * Construct an object of type D, one of Ds, forwarding args to its
+   * constructor.
+   */
+  template <typename D, typename... Args>
+  explicit tagged_value_ptr(in_place_type_t<D>, Args&&... args)
+      : bits_(pack(detail::tagged_ops_for<Base, D>::create(
+                       std::forward<Args>(args)...),
+          tag<D>()))
+  {
+  }
+
+  tagged_value_ptr(tagged_value_ptr const& other)
+      : bits_(other ? pack(ops(other.index()).clone(other.get()), other.index())
+                    : 0)
+  {
+  }
+
+  tagged_value_ptr(tagged_value_ptr&& other) noexcept
+      : bits_(other.bits_)
+  {
+    other.bits_ = 0;
+  }
+
+  tagged_value_ptr& operator=(tagged_value_ptr const& other)
+  {
+    tagged_value_ptr(other).swap(*this);
+    return *this;
+  }
+
+  tagged_value_ptr& operator=(tagged_value_ptr&& other) noexcept
+  {
+    tagged_value_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~tagged_value_ptr() { reset(); }
+
+  Base* get() const noexcept
+  {
+    return reinterpret_cast<Base*>(bits_ & ~tag_mask);
+  }
+
+  Base& operator*() const noexcept { return *get(); }
+
+  Base* operator->() const noexcept { return get(); }
+
+  explicit operator bool() const noexcept { return bits_ != 0; }
+
+  /**
+   * The position in Ds of the type of the object, or 0 if there is none.
+   */
+  std::size_t index() const noexcept
+  {
+    return static_cast<std::size_t>(bits_ & tag_mask);
+  }
+
+  /**
+   * Get the object if its type is D, or null otherwise, without RTTI.
+   */
+  template <typename D>
+  D* get_if() const noexcept
+  {
+    return *this && index() == tag<D>() ? static_cast<D*>(get()) : nullptr;
+  }
+
+  void reset(std::nullptr_t = nullptr) noexcept
+  {
+    if (bits_) {
+      ops(index()).destroy(get());
+      bits_ = 0;
+    }
+  }
+
+  template <typename D, typename... Args>
+  D& emplace(Args&&... args)
+  {
+    tagged_value_ptr(in_place_type_t<D>{}, std::forward<Args>(args)...)
+        .swap(*this);
+    return static_cast<D&>(*get());
+  }
+
+  void swap(tagged_value_ptr& other) noexcept
+  {
+    std::swap(bits_, other.bits_);
+  }
+
+private:
+  template <typename D>
+  static constexpr std::size_t tag() noexcept
+  {
+    static_assert(detail::tag_of<D, Ds...>::value < sizeof...(Ds),
+        "D is not one of the types of this tagged_value_ptr");
+    static_assert(std::is_base_of<Base, D>::value, "D must derive from Base");
+
+    return detail::tag_of<D, Ds...>::value;
+  }
+
+  static detail::tagged_ops<Base> const& ops(std::size_t index) noexcept
+  {
+    return detail::tagged_table<Base, Ds...>::value[index];
+  }
+
+  static std::uintptr_t pack(Base* ptr, std::size_t index) noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(ptr) | index;
+  }
+
+  std::uintptr_t bits_ = 0;
+};
+
+template <typename Base, typename... Ds>
+constexpr std::uintptr_t tagged_value_ptr<Base, Ds...>::tag_mask;
+
+template <typename Base, typename... Ds>
+void swap(tagged_value_ptr<Base, Ds...>& a,
+    tagged_value_ptr<Base, Ds...>& b) noexcept
+{
+  a.swap(b);
+}
+
+template <typename Base, typename... Ds>
+bool operator==(tagged_value_ptr<Base, Ds...> const& a,
+    tagged_value_ptr<Base, Ds...> const& b) noexcept
+{
+  return a.get() == b.get();
+}
+
+template <typename Base, typename... Ds>
+bool operator!=(tagged_value_ptr<Base, Ds...> const& a,
+    tagged_value_ptr<Base, Ds...> const& b) noexcept
+{
+  return !(a == b);
+}
+
+template <typename Base, typename... Ds>
+bool operator==(tagged_value_ptr<Base, Ds...> const& a, std::nullptr_t) noexcept
+{
+  return !a;
+}
+
+template <typename Base, typename... Ds>
+bool operator!=(tagged_value_ptr<Base, Ds...> const& a, std::nullptr_t) noexcept
+{
+  return static_cast<bool>(a);
+}
+
+} // namespace bsc
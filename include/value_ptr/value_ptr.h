@@ -11,12 +11,894 @@
  */
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(VP_PROFILE_TYPES)
+#include <algorithm>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#endif
+
+#if defined(VP_PROFILE_COPIES)
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VP_LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#define VP_LIKELY(x) (x)
+#endif
+
+#if defined(_MSC_VER)
+#define VP_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__) || defined(__clang__)
+#define VP_NOINLINE __attribute__((noinline))
+#else
+#define VP_NOINLINE
+#endif
+
+// The copy operations have to be out of line for their return address to
+// identify the code that called them.
+#if !defined(VP_PROFILE_COPIES)
+#define VP_COPY_SITE
+#elif defined(_MSC_VER)
+#define VP_COPY_SITE __declspec(noinline)
+#define VP_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define VP_COPY_SITE __attribute__((noinline))
+#define VP_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+// Whether exceptions are enabled. Without them (e.g. with -fno-exceptions),
+// errors that would throw abort instead; use the try_ functions and nothrow
+// constructors to handle allocation failure.
+#if !defined(VP_HAS_EXCEPTIONS)
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define VP_HAS_EXCEPTIONS 1
+#else
+#define VP_HAS_EXCEPTIONS 0
+#endif
+#endif
+
+#if VP_HAS_EXCEPTIONS
+#define VP_TRY try
+#define VP_CATCH_ALL catch (...)
+#define VP_RETHROW throw
+#define VP_THROW(e) throw e
+#else
+#define VP_TRY if (true)
+#define VP_CATCH_ALL if (false)
+#define VP_RETHROW static_cast<void>(0)
+#define VP_THROW(e) std::abort()
+#endif
+
+// In C++20, objects can be allocated and freed during constant evaluation, so
+// value_ptrs can be created, copied and destroyed in constexpr functions.
+#if __cpp_constexpr_dynamic_alloc && __cpp_lib_is_constant_evaluated
+#define VP_HAS_CONSTEXPR20 1
+#define VP_CONSTEXPR20 constexpr
+#else
+#define VP_HAS_CONSTEXPR20 0
+#define VP_CONSTEXPR20
+#endif
+
+#if !defined(VP_CACHE_LINE_SIZE)
+#define VP_CACHE_LINE_SIZE 64
+#endif
 
 namespace bsc {
 
+#if __cplusplus >= 201703L
+using std::in_place_type;
+using std::in_place_type_t;
+#else
+/**
+ * Tag type used to select the in-place constructor of value_ptr, which
+ * constructs an object of type D directly into storage chosen by the library.
+ *
+ * In C++17 and later this is std::in_place_type_t.
+ */
+template <typename D>
+struct in_place_type_t {
+  explicit in_place_type_t() = default;
+};
+
+#if __cplusplus >= 201402L
+template <typename D>
+constexpr in_place_type_t<D> in_place_type{};
+#endif
+#endif
+
+/**
+ * Opt-in trait for self-referential types built out of value_ptr members
+ * (linked lists, trees etc.).
+ *
+ * Copying or destroying a value_ptr<T> normally recurses through the copy
+ * constructors and destructors of every object reachable from it, which will
+ * overflow the stack for long enough chains. Specializing this trait to
+ * inherit from std::true_type makes copies and destruction of value_ptr<T>
+ * iterative instead: nested operations are pushed onto a thread-local worklist
+ * and processed by the outermost one.
+ *
+ * Deferred copies are completed by the time the outermost copy returns, but
+ * while T's copy constructor runs its value_ptr<T> members are still null. The
+ * copy constructor of T must therefore copy those members directly into place
+ * (as the implicit copy constructor does), and not inspect them or copy them
+ * via a temporary. Assigning to them in the body of the copy constructor is
+ * safe, but the copies made that way are completed before the assignment
+ * returns, and so recurse as they would without this trait.
+ */
+template <typename T>
+struct enable_iterative_ownership : std::false_type {
+};
+
+/**
+ * Opt-in trait that reserves a link in the bookkeeping allocated with each
+ * object managed by a value_ptr<T>, so that intrusive containers (such as
+ * mpsc_queue in value_ptr/mpsc_queue.h) can hold value_ptr<T>s without
+ * allocating nodes of their own.
+ *
+ * Specializing this trait to inherit from std::true_type adds one pointer to
+ * each allocation; otherwise there is no cost.
+ */
+template <typename T>
+struct enable_queue_hook : std::false_type {
+};
+
+/**
+ * Tag type used to select the constructor of value_ptr that aligns the object
+ * to a cache line (VP_CACHE_LINE_SIZE bytes, 64 by default).
+ */
+struct cache_aligned_t {
+  explicit cache_aligned_t() = default;
+};
+
+constexpr cache_aligned_t cache_aligned{};
+
+namespace detail {
+
+/**
+ * Type-erased base of every model, so that models managed by value_ptrs of
+ * different element types can be stored together.
+ */
+struct model_base {
+  VP_CONSTEXPR20 virtual ~model_base() {}
+};
+
+/**
+ * Whether the call is being evaluated at compile time, which is never the
+ * case before C++20.
+ */
+constexpr bool is_constant_evaluated() noexcept
+{
+#if VP_HAS_CONSTEXPR20
+  return std::is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+
+/**
+ * Link to the next model in an intrusive queue (see enable_queue_hook).
+ */
+struct queue_hook {
+  std::atomic<queue_hook*> queue_next{ nullptr };
+};
+
+struct no_queue_hook {
+};
+
+template <typename T>
+using queue_hook_for = typename std::conditional<enable_queue_hook<T>::value,
+    queue_hook, no_queue_hook>::type;
+
+/**
+ * The alignment guaranteed by operator new(std::size_t).
+ */
+constexpr std::size_t default_new_alignment =
+#if defined(__STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#else
+    alignof(std::max_align_t);
+#endif
+
+/**
+ * Allocate size bytes aligned to align, which must be a power of two.
+ *
+ * Before C++17 there is no aligned operator new, so over-aligned blocks are
+ * over-allocated instead, and the pointer returned by operator new is stored
+ * immediately before the aligned address for deallocate to find.
+ */
+inline void* allocate(std::size_t size, std::size_t align)
+{
+  if (align <= default_new_alignment) {
+    return ::operator new(size);
+  }
+
+#if defined(__cpp_aligned_new)
+  return ::operator new(size, std::align_val_t(align));
+#else
+  // The raw block is aligned to at least twice the size of a pointer, so
+  // rounding past the stored pointer moves forward by at most align bytes.
+  auto raw = static_cast<char*>(::operator new(size + align));
+  auto addr = reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+  auto aligned = reinterpret_cast<void*>(
+      (addr + align - 1) & ~static_cast<std::uintptr_t>(align - 1));
+  static_cast<void**>(aligned)[-1] = raw;
+  return aligned;
+#endif
+}
+
+/**
+ * Allocate as above, returning null instead of throwing if there is no memory.
+ */
+inline void* try_allocate(std::size_t size, std::size_t align) noexcept
+{
+  if (align <= default_new_alignment) {
+    return ::operator new(size, std::nothrow);
+  }
+
+#if defined(__cpp_aligned_new)
+  return ::operator new(size, std::align_val_t(align), std::nothrow);
+#else
+  auto raw = static_cast<char*>(::operator new(size + align, std::nothrow));
+  if (!raw) {
+    return nullptr;
+  }
+
+  auto addr = reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+  auto aligned = reinterpret_cast<void*>(
+      (addr + align - 1) & ~static_cast<std::uintptr_t>(align - 1));
+  static_cast<void**>(aligned)[-1] = raw;
+  return aligned;
+#endif
+}
+
+/**
+ * Free a block returned by allocate or try_allocate with the same alignment.
+ */
+inline void deallocate(void* ptr, std::size_t align) noexcept
+{
+  if (align <= default_new_alignment) {
+    ::operator delete(ptr);
+    return;
+  }
+
+#if defined(__cpp_aligned_new)
+  ::operator delete(ptr, std::align_val_t(align));
+#else
+  if (ptr) {
+    ::operator delete(static_cast<void**>(ptr)[-1]);
+  }
+#endif
+}
+
+/**
+ * Whether A can allocate value_ptr models. It needs a member
+ * allocate(size, align), and a static deallocate(ptr) that frees a block
+ * without being told which arena it came from (a deleting destructor can't
+ * pass one).
+ */
+template <typename A, typename = void>
+struct is_model_arena : std::false_type {
+};
+
+template <typename A>
+struct is_model_arena<A,
+    decltype(void(std::declval<A&>().allocate(std::size_t(), std::size_t())),
+        void(A::deallocate(std::declval<void*>())))> : std::true_type {
+};
+
+/**
+ * Allocate from arena, returning null if it has no memory: with its member
+ * try_allocate(size, align) if it has one, and otherwise by catching the
+ * std::bad_alloc thrown by allocate (when there are exceptions to catch).
+ */
+template <typename A>
+auto try_allocate_from(A& arena, std::size_t size, std::size_t align, int)
+    -> decltype(static_cast<void*>(arena.try_allocate(size, align)))
+{
+  return arena.try_allocate(size, align);
+}
+
+template <typename A>
+void* try_allocate_from(A& arena, std::size_t size, std::size_t align, long)
+{
+#if VP_HAS_EXCEPTIONS
+  try {
+    return arena.allocate(size, align);
+  } catch (std::bad_alloc const&) {
+    return nullptr;
+  }
+#else
+  return arena.allocate(size, align);
+#endif
+}
+
+/**
+ * Base class that gives Model allocation functions honouring alignof(Model).
+ *
+ * A new-expression for an over-aligned class only uses aligned operator new
+ * if the class doesn't declare an unaligned one, and doesn't use it at all
+ * before C++17. Blocks are freed without passing a size, because a block may
+ * be reused for a model smaller than the one it was allocated for.
+ */
+template <typename Model>
+struct aligned_allocation {
+  static void* operator new(std::size_t size)
+  {
+    return allocate(size, alignof(Model));
+  }
+
+  static void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+  {
+    return try_allocate(size, alignof(Model));
+  }
+
+  static void operator delete(void* ptr) noexcept
+  {
+    deallocate(ptr, alignof(Model));
+  }
+
+  // Called if the constructor throws after a nothrow allocation.
+  static void operator delete(void* ptr, std::nothrow_t const&) noexcept
+  {
+    deallocate(ptr, alignof(Model));
+  }
+};
+
+/**
+ * Identifies a type by address, so that the dynamic types of two models can
+ * be compared without RTTI.
+ */
+struct type_descriptor {
+  // A compiler-specific function signature containing the name of the type,
+  // for use in diagnostics.
+  char const* (*signature)();
+};
+
+template <typename D>
+struct type_of {
+  static char const* signature() noexcept
+  {
+#if defined(_MSC_VER)
+    return __FUNCSIG__;
+#else
+    return __PRETTY_FUNCTION__;
+#endif
+  }
+
+  static const type_descriptor value;
+};
+
+template <typename D>
+const type_descriptor type_of<D>::value = { &type_of<D>::signature };
+
+template <typename From, typename To, typename = void>
+struct can_static_cast : std::false_type {
+};
+
+template <typename From, typename To>
+struct can_static_cast<From, To,
+    decltype(void(static_cast<To>(std::declval<From>())))> : std::true_type {
+};
+
+template <typename To, typename From, typename Model>
+To* object_cast(From* ptr, Model const*, std::true_type) noexcept
+{
+  return static_cast<To*>(ptr);
+}
+
+template <typename To, typename From, typename Model>
+To* object_cast(From*, Model const* model, std::false_type) noexcept
+{
+  return static_cast<To*>(const_cast<void*>(model->object()));
+}
+
+/**
+ * Convert ptr, which points to the object managed by model, to To*.
+ *
+ * This is a static_cast where one is allowed. Otherwise (when casting down
+ * from a virtual base) the object's dynamic type must be exactly To, and the
+ * model is asked for the object's address instead.
+ */
+template <typename To, typename From, typename Model>
+To* object_cast(From* ptr, Model const* model) noexcept
+{
+  return object_cast<To>(ptr, model, can_static_cast<From*, To*>{});
+}
+
+/**
+ * The largest object that assign_object copies onto the stack; larger ones are
+ * assigned by replacing the model instead.
+ */
+constexpr std::size_t max_assign_temporary = 4096;
+
+/**
+ * Whether assign_object can assign to a D in place.
+ */
+template <typename D>
+using assignable_in_place = std::integral_constant<bool,
+    std::is_copy_constructible<D>::value && std::is_move_assignable<D>::value
+        && sizeof(D) <= max_assign_temporary>;
+
+/**
+ * Assign a copy of the object at src to dest if src has dynamic type D (as
+ * identified by type), returning false otherwise.
+ *
+ * The copy is made before dest is modified, because src may be owned by dest
+ * (as in `head = head->next`), and then moved into dest.
+ */
+template <typename D>
+bool assign_object(
+    D& dest, type_descriptor const* type, void const* src, std::true_type)
+{
+  if (type != &type_of<D>::value) {
+    return false;
+  }
+
+  auto copy = D(*static_cast<D const*>(src));
+
+  // Types with a user-declared copy constructor or destructor have no
+  // implicit move assignment, and may only have a deprecated implicit copy
+  // assignment; using it here is not the user's doing, so don't warn about it.
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-warning-option"
+#pragma clang diagnostic ignored "-Wdeprecated-copy"
+#pragma clang diagnostic ignored "-Wdeprecated-copy-with-user-provided-copy"
+#pragma clang diagnostic ignored "-Wdeprecated-copy-with-dtor"
+#pragma clang diagnostic ignored "-Wdeprecated-copy-with-user-provided-dtor"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wdeprecated-copy"
+#pragma GCC diagnostic ignored "-Wdeprecated-copy-dtor"
+#endif
+  dest = std::move(copy);
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+  return true;
+}
+
+template <typename D>
+bool assign_object(
+    D&, type_descriptor const*, void const*, std::false_type) noexcept
+{
+  return false;
+}
+
+/**
+ * The bytes owned by obj beyond sizeof(D), as reported by a deep_size_members
+ * overload found by argument-dependent lookup, or zero if there isn't one.
+ */
+template <typename D>
+auto nested_size(D const& obj, int)
+    -> decltype(static_cast<std::size_t>(deep_size_members(obj)))
+{
+  return static_cast<std::size_t>(deep_size_members(obj));
+}
+
+template <typename D>
+std::size_t nested_size(D const&, long)
+{
+  return 0;
+}
+
+/**
+ * Move obj into a new allocation that the caller will free with delete, or
+ * copy it if D's move constructor is deleted.
+ *
+ * Before C++17, delete can only free blocks from the unaligned operator new,
+ * so an over-aligned D is under-aligned here; there is no allocation that both
+ * respects its alignment and can be freed by the caller.
+ */
+template <typename D>
+D* new_released(D&& obj)
+{
+  using source = typename std::conditional<
+      std::is_move_constructible<D>::value, D&&, D const&>::type;
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wover-aligned"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waligned-new="
+#endif
+  return new D(static_cast<source>(obj));
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+}
+
+/**
+ * A copy of a value_ptr that has been deferred by an iterative clone; run
+ * writes a clone of src into the impl_ member pointed to by dest.
+ */
+struct pending_clone {
+  void* dest;
+  model_base* src;
+  void (*run)(void*, model_base*);
+};
+
+template <typename Work>
+struct worklist {
+  bool active = false;
+  std::vector<Work> pending;
+};
+
+// Whether this thread's teardown worklist has been destroyed, which happens at
+// thread exit before the destruction of thread_locals constructed before it
+// (e.g. retire queues), and of every static.
+inline bool& teardown_worklist_destroyed() noexcept
+{
+  static thread_local bool destroyed = false;
+  return destroyed;
+}
+
+struct teardown_worklist_type : worklist<model_base*> {
+  ~teardown_worklist_type() { teardown_worklist_destroyed() = true; }
+};
+
+inline worklist<model_base*>& teardown_worklist() noexcept
+{
+  static thread_local teardown_worklist_type list;
+  return list;
+}
+
+// The worklist of the iterative destruction running on this thread, if any.
+// A plain pointer so that it can still be used after teardown_worklist() has
+// been destroyed.
+inline worklist<model_base*>*& running_teardown() noexcept
+{
+  static thread_local worklist<model_base*>* list = nullptr;
+  return list;
+}
+
+inline worklist<pending_clone>& clone_worklist() noexcept
+{
+  static thread_local worklist<pending_clone> list;
+  return list;
+}
+
+/**
+ * Destroy a model without recursing into the destruction of nested models.
+ *
+ * If called while another iterative destruction is running on this thread,
+ * the model is queued and destroyed by the outermost call instead.
+ */
+inline void destroy_iteratively(model_base* model) noexcept
+{
+  auto& running = running_teardown();
+
+  if (running) {
+    VP_TRY
+    {
+      running->pending.push_back(model);
+    }
+    VP_CATCH_ALL
+    {
+      // Out of memory for the worklist; fall back to recursing.
+      delete model;
+    }
+    return;
+  }
+
+  // The thread's own worklist keeps its capacity between calls, but models
+  // destroyed during or after its destruction need one of their own.
+  auto fallback = worklist<model_base*>{};
+  auto& list
+      = teardown_worklist_destroyed() ? fallback : teardown_worklist();
+
+  running = &list;
+  delete model;
+
+  while (!list.pending.empty()) {
+    auto next = list.pending.back();
+    list.pending.pop_back();
+    delete next;
+  }
+
+  running = nullptr;
+}
+
+/**
+ * Gives the other headers in this library access to the internals of
+ * value_ptr.
+ */
+struct access;
+
+#if defined(VP_PROFILE_TYPES)
+/**
+ * Extract the type name from a type_of<D>::signature() string.
+ */
+inline std::string type_name(type_descriptor const* type)
+{
+  auto sig = std::string(type->signature());
+
+  // GCC: "... [with D = Name]", Clang: "... [D = Name]",
+  // MSVC: "... type_of<Name>::signature(void) noexcept"
+  auto start = sig.find("D = ");
+  auto end = sig.rfind(']');
+  if (start != std::string::npos && end != std::string::npos) {
+    start += 4;
+    return sig.substr(start, end - start);
+  }
+
+  start = sig.find("type_of<");
+  end = sig.rfind(">::signature");
+  if (start != std::string::npos && end != std::string::npos) {
+    start += 8;
+    return sig.substr(start, end - start);
+  }
+
+  return sig;
+}
+
+struct type_profile_data {
+  std::mutex mutex;
+  std::unordered_map<type_descriptor const*, std::size_t> counts;
+};
+
+template <typename T>
+type_profile_data& type_profile_for()
+{
+  static type_profile_data data;
+  return data;
+}
+
+template <typename T>
+void record_type(type_descriptor const* type)
+{
+  auto& data = type_profile_for<T>();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  ++data.counts[type];
+}
+#endif
+
+#if defined(VP_PROFILE_COPIES)
+struct copy_site_stats {
+  std::size_t copies;
+  std::size_t bytes;
+};
+
+struct copy_profile_data {
+  // Dumps the profile to std::cerr at exit.
+  ~copy_profile_data();
+
+  std::mutex mutex;
+  std::unordered_map<void const*, copy_site_stats> sites;
+};
+
+inline copy_profile_data& copy_profile_for()
+{
+  static copy_profile_data data;
+  return data;
+}
+
+inline void record_copy(void const* return_address, std::size_t bytes)
+{
+  // The return address is the instruction after the call; step back into the
+  // call so that symbolizers report its line.
+  auto site = static_cast<char const*>(return_address) - 1;
+
+  auto& data = copy_profile_for();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  auto& stats = data.sites[site];
+  ++stats.copies;
+  stats.bytes += bytes;
+}
+#endif
+
+} // namespace detail
+
+#if defined(VP_PROFILE_TYPES)
+/**
+ * The dynamic types of the objects accessed through value_ptr<T>.
+ *
+ * When VP_PROFILE_TYPES is defined, every dereference of a value_ptr<T> (with
+ * operator->, operator* or with_likely) records the dynamic type of its
+ * object. Where one type dominates, value_ptr::with_likely can be used to
+ * call it without virtual dispatch.
+ *
+ * Recording takes a lock, so this is meant for diagnostic builds only. Every
+ * translation unit in a program must agree on whether VP_PROFILE_TYPES is
+ * defined.
+ */
+template <typename T>
+struct type_profile {
+  struct entry {
+    std::string type;
+    std::size_t count;
+  };
+
+  /**
+   * Get the number of times each type has been seen, most frequent first.
+   */
+  static std::vector<entry> snapshot()
+  {
+    auto& data = detail::type_profile_for<T>();
+    auto entries = std::vector<entry>{};
+
+    {
+      std::lock_guard<std::mutex> lock(data.mutex);
+      for (auto const& pair : data.counts) {
+        entries.push_back({ detail::type_name(pair.first), pair.second });
+      }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](entry const& a, entry const& b) { return a.count > b.count; });
+    return entries;
+  }
+
+  /**
+   * Discard everything recorded so far.
+   */
+  static void reset()
+  {
+    auto& data = detail::type_profile_for<T>();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.counts.clear();
+  }
+
+  /**
+   * Write a human-readable summary of the profile to os.
+   */
+  static void dump(std::ostream& os)
+  {
+    auto entries = snapshot();
+
+    auto total = std::size_t{ 0 };
+    for (auto const& e : entries) {
+      total += e.count;
+    }
+
+    os << "value_ptr<" << detail::type_name(&detail::type_of<T>::value)
+       << ">: " << total << " dereferences\n";
+
+    for (auto const& e : entries) {
+      os << "  " << (100.0 * e.count / total) << "% " << e.type << " ("
+         << e.count << ")\n";
+    }
+  }
+};
+#endif
+
+#if defined(VP_PROFILE_COPIES)
+/**
+ * The call sites at which value_ptrs are deep-copied.
+ *
+ * When VP_PROFILE_COPIES is defined, every copy of a non-empty value_ptr
+ * (copy construction, including conversion from an lvalue of another
+ * value_ptr type, and copy assignment) records the address it was called
+ * from, and the deep_size of the copy. Nested copies made while copying an
+ * object are recorded at their own sites too, so their bytes are counted
+ * again there. The profile is written to std::cerr at exit.
+ *
+ * Recording takes a lock, so this is meant for diagnostic builds only. Every
+ * translation unit in a program must agree on whether VP_PROFILE_COPIES is
+ * defined.
+ */
+struct copy_profile {
+  struct entry {
+    void const* site;
+    std::size_t copies;
+    std::size_t bytes;
+  };
+
+  /**
+   * Get the number of copies and bytes copied at each site, most bytes first.
+   */
+  static std::vector<entry> snapshot()
+  {
+    auto& data = detail::copy_profile_for();
+    auto entries = std::vector<entry>{};
+
+    {
+      std::lock_guard<std::mutex> lock(data.mutex);
+      for (auto const& pair : data.sites) {
+        entries.push_back(
+            { pair.first, pair.second.copies, pair.second.bytes });
+      }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](entry const& a, entry const& b) { return a.bytes > b.bytes; });
+    return entries;
+  }
+
+  /**
+   * Discard everything recorded so far.
+   */
+  static void reset()
+  {
+    auto& data = detail::copy_profile_for();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.sites.clear();
+  }
+
+  /**
+   * Describe a call site as module+offset where possible, which can be passed
+   * to addr2line (e.g. addr2line -f -C -e module offset).
+   */
+  static std::string describe(void const* site)
+  {
+    char buffer[32];
+#if defined(__unix__) || defined(__APPLE__)
+    auto info = Dl_info{};
+    if (dladdr(site, &info) && info.dli_fname) {
+      auto offset = static_cast<char const*>(site)
+          - static_cast<char const*>(info.dli_fbase);
+      std::snprintf(buffer, sizeof(buffer), "+0x%tx", offset);
+      return info.dli_fname + std::string(buffer);
+    }
+#endif
+    std::snprintf(buffer, sizeof(buffer), "%p", site);
+    return buffer;
+  }
+
+  /**
+   * Write a human-readable summary of the profile to os.
+   */
+  static void dump(std::ostream& os)
+  {
+    auto entries = snapshot();
+
+    auto copies = std::size_t{ 0 };
+    auto bytes = std::size_t{ 0 };
+    for (auto const& e : entries) {
+      copies += e.copies;
+      bytes += e.bytes;
+    }
+
+    os << "value_ptr copies: " << copies << " (" << bytes << " bytes) from "
+       << entries.size() << " sites\n";
+
+    for (auto const& e : entries) {
+      os << "  " << e.copies << " copies, " << e.bytes << " bytes at "
+         << describe(e.site) << "\n";
+    }
+  }
+};
+
+inline detail::copy_profile_data::~copy_profile_data()
+{
+  if (!sites.empty()) {
+    copy_profile::dump(std::cerr);
+  }
+}
+#endif
+
 /**
  * Smart pointer class with value semantics.
  */
@@ -32,49 +914,463 @@ public:
   template <typename U>
   friend class value_ptr;
 
+  friend struct detail::access;
+
 private:
-  struct pmr_concept {
-    virtual ~pmr_concept() {}
+  struct pmr_concept : detail::model_base, detail::queue_hook_for<T> {
+    VP_CONSTEXPR20 pmr_concept(
+        T* ptr, detail::type_descriptor const* type) noexcept
+        : ptr_(ptr)
+        , type_(type)
+    {
+    }
+
+    virtual pmr_concept* clone() const = 0;
+
+    // As clone, but returns null if the model can't be allocated.
+    virtual pmr_concept* try_clone() const = 0;
+
+    // Returns a pointer that the caller must free with delete.
+    virtual T* release() = 0;
+
+    // Assigns a copy of object to this model's object if it has the same
+    // dynamic type, identified by type, returning false otherwise.
+    virtual bool assign(
+        detail::type_descriptor const* type, void const* object)
+        = 0;
+
+    // The object as its dynamic type, for use once type_ has been checked.
+    virtual void const* object() const noexcept = 0;
+
+    // The size of the model, and so a lower bound on the size of its block, or
+    // zero if the block can't be reused for other models.
+    virtual std::size_t capacity() const noexcept = 0;
 
-    virtual pmr_concept* clone() = 0;
-    virtual T* get() noexcept = 0;
-    virtual T& operator*() noexcept = 0;
-    virtual T* release() noexcept = 0;
+    // The alignment of the model, which its block was allocated with.
+    virtual std::size_t alignment() const noexcept = 0;
+
+    // The bytes allocated for the model and its object, plus those owned by
+    // the object in turn.
+    virtual std::size_t deep_size() const = 0;
+
+    // If this model is an adapter around a model of the concept identified by
+    // target, give up ownership of that model and return it.
+    virtual detail::model_base* unwrap(
+        detail::type_descriptor const* /* target */) noexcept
+    {
+      return nullptr;
+    }
+
+    // Cached so that accessing the object does not need a virtual call.
+    T* ptr_;
+
+    detail::type_descriptor const* type_;
   };
 
-  template <typename D>
-  struct pmr_model : pmr_concept {
+  template <typename D, std::size_t Align = alignof(D)>
+  struct pmr_inline_model;
+
+  // Owns an object that was allocated separately by the user, and frees it
+  // with Deleter.
+  template <typename D, typename Deleter = std::default_delete<D>>
+  struct pmr_model : pmr_concept,
+                     detail::aligned_allocation<pmr_model<D, Deleter>> {
     pmr_model(D* ptr) noexcept
-        : ptr_(ptr)
+        : pmr_model(std::unique_ptr<D, Deleter>(ptr))
+    {
+    }
+
+    pmr_model(std::unique_ptr<D, Deleter>&& ptr) noexcept
+        : pmr_concept(ptr.get(), &detail::type_of<D>::value)
+        , obj_(std::move(ptr))
+    {
+    }
+
+    pmr_concept* clone() const override
+    {
+      return new pmr_inline_model<D>(*obj_);
+    }
+
+    pmr_concept* try_clone() const override
+    {
+      return new (std::nothrow) pmr_inline_model<D>(*obj_);
+    }
+
+    D* release() override
+    {
+      auto ptr = release_object(
+          std::is_same<Deleter, std::default_delete<D>>{});
+      this->ptr_ = nullptr;
+      return ptr;
+    }
+
+    D* release_object(std::true_type) noexcept { return obj_.release(); }
+
+    // The caller will free the result with delete rather than Deleter, so it
+    // has to be moved into an allocation of its own.
+    D* release_object(std::false_type)
+    {
+      auto ptr = detail::new_released(std::move(*obj_));
+      obj_.reset();
+      return ptr;
+    }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return detail::assign_object(
+          *obj_, type, object, detail::assignable_in_place<D>{});
+    }
+
+    void const* object() const noexcept override { return obj_.get(); }
+
+    std::size_t capacity() const noexcept override { return sizeof(*this); }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_model);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + sizeof(D) + detail::nested_size(*obj_, 0);
+    }
+
+    std::unique_ptr<D, Deleter> obj_;
+  };
+
+  // Stores the object in the same allocation as the model itself, aligned to
+  // at least Align.
+  template <typename D, std::size_t Align>
+  struct pmr_inline_model : pmr_concept,
+                            detail::aligned_allocation<
+                                pmr_inline_model<D, Align>> {
+    template <typename... Args>
+    explicit pmr_inline_model(Args&&... args)
+        : pmr_concept(nullptr, &detail::type_of<D>::value)
+        , obj_(std::forward<Args>(args)...)
+    {
+      this->ptr_ = &obj_;
+    }
+
+    pmr_concept* clone() const override
+    {
+      return new pmr_inline_model(obj_);
+    }
+
+    pmr_concept* try_clone() const override
+    {
+      return new (std::nothrow) pmr_inline_model(obj_);
+    }
+
+    // The object can't outlive this allocation, so it is moved to a new one.
+    D* release() override { return detail::new_released(std::move(obj_)); }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return detail::assign_object(
+          obj_, type, object, detail::assignable_in_place<D>{});
+    }
+
+    void const* object() const noexcept override { return &obj_; }
+
+    std::size_t capacity() const noexcept override { return sizeof(*this); }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_inline_model);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + detail::nested_size(obj_, 0);
+    }
+
+    alignas(Align) alignas(D) D obj_;
+  };
+
+#if VP_HAS_CONSTEXPR20
+  // Stands in for pmr_inline_model during constant evaluation, which can only
+  // allocate with the global operator new. Its allocations can't outlive the
+  // evaluation, so it is never seen at run time.
+  template <typename D>
+  struct pmr_constexpr_model : pmr_concept {
+    template <typename... Args>
+    constexpr explicit pmr_constexpr_model(Args&&... args)
+        : pmr_concept(nullptr, &detail::type_of<D>::value)
+        , obj_(std::forward<Args>(args)...)
+    {
+      this->ptr_ = &obj_;
+    }
+
+    // Before GCC 13, implicit constexpr virtual destructors can't be called
+    // during constant evaluation.
+    constexpr ~pmr_constexpr_model() override {}
+
+    constexpr pmr_concept* clone() const override
+    {
+      return new pmr_constexpr_model(obj_);
+    }
+
+    pmr_concept* try_clone() const override { return clone(); }
+
+    D* release() override { return detail::new_released(std::move(obj_)); }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return detail::assign_object(
+          obj_, type, object, detail::assignable_in_place<D>{});
+    }
+
+    void const* object() const noexcept override { return &obj_; }
+
+    std::size_t capacity() const noexcept override { return 0; }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_constexpr_model);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + detail::nested_size(obj_, 0);
+    }
+
+    D obj_;
+  };
+
+  // Stands in for pmr_model during constant evaluation, for the same reason.
+  template <typename D>
+  struct pmr_constexpr_adopted_model : pmr_concept {
+    constexpr explicit pmr_constexpr_adopted_model(D* ptr) noexcept
+        : pmr_concept(ptr, &detail::type_of<D>::value)
+        , obj_(ptr)
+    {
+    }
+
+    constexpr ~pmr_constexpr_adopted_model() override { delete obj_; }
+
+    constexpr pmr_concept* clone() const override
+    {
+      return new pmr_constexpr_model<D>(*obj_);
+    }
+
+    pmr_concept* try_clone() const override { return clone(); }
+
+    D* release() override
+    {
+      auto ptr = obj_;
+      obj_ = nullptr;
+      this->ptr_ = nullptr;
+      return ptr;
+    }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return detail::assign_object(
+          *obj_, type, object, detail::assignable_in_place<D>{});
+    }
+
+    void const* object() const noexcept override { return obj_; }
+
+    std::size_t capacity() const noexcept override { return 0; }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_constexpr_adopted_model);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + sizeof(D) + detail::nested_size(*obj_, 0);
+    }
+
+    D* obj_;
+  };
+#endif
+
+  // Stores the object in a block allocated from an arena, and allocates copies
+  // from the same arena.
+  template <typename D, typename Arena>
+  struct pmr_arena_model : pmr_concept {
+    template <typename... Args>
+    explicit pmr_arena_model(Arena& arena, Args&&... args)
+        : pmr_concept(nullptr, &detail::type_of<D>::value)
+        , arena_(&arena)
+        , obj_(std::forward<Args>(args)...)
+    {
+      this->ptr_ = &obj_;
+    }
+
+    static void* operator new(std::size_t size, Arena& arena)
+    {
+      return arena.allocate(size, alignof(pmr_arena_model));
+    }
+
+    // Called if the constructor throws.
+    static void operator delete(void* ptr, Arena&) noexcept
+    {
+      Arena::deallocate(ptr);
+    }
+
+    static void operator delete(void* ptr) noexcept { Arena::deallocate(ptr); }
+
+    pmr_concept* clone() const override
     {
+      return new (*arena_) pmr_arena_model(*arena_, obj_);
     }
 
-    ~pmr_model() noexcept(std::is_nothrow_destructible<D>::value)
+    pmr_concept* try_clone() const override
     {
-      if (ptr_) {
-        delete ptr_;
+      auto block = detail::try_allocate_from(
+          *arena_, sizeof(pmr_arena_model), alignof(pmr_arena_model), 0);
+      if (!block) {
+        return nullptr;
+      }
+
+      VP_TRY
+      {
+        return ::new (block) pmr_arena_model(*arena_, obj_);
+      }
+      VP_CATCH_ALL
+      {
+        Arena::deallocate(block);
+        VP_RETHROW;
       }
+      return nullptr;
     }
 
-    // noexcept only if the underlying type can be copied without throwing.
-    pmr_model<D>* clone() noexcept(
-        std::is_nothrow_copy_constructible<D>::value) override
+    D* release() override { return detail::new_released(std::move(obj_)); }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return detail::assign_object(
+          obj_, type, object, detail::assignable_in_place<D>{});
+    }
+
+    void const* object() const noexcept override { return &obj_; }
+
+    // Other models are allocated from the heap, and would be freed there.
+    std::size_t capacity() const noexcept override { return 0; }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_arena_model);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + detail::nested_size(obj_, 0);
+    }
+
+    Arena* arena_;
+    D obj_;
+  };
+
+  // Exposes the model of a value_ptr<U> as a model for this element type, so
+  // that converting between value_ptr types does not copy the object.
+  template <typename U>
+  struct pmr_adapter : pmr_concept,
+                       detail::aligned_allocation<pmr_adapter<U>> {
+    using inner_concept = typename value_ptr<U>::pmr_concept;
+
+    explicit pmr_adapter(inner_concept* inner) noexcept
+        : pmr_concept(
+            detail::object_cast<T>(inner->ptr_, inner), inner->type_)
+        , inner_(inner)
     {
-      return new pmr_model<D>(new D(*ptr_));
     }
 
-    D* get() noexcept override { return ptr_; }
+    ~pmr_adapter() { value_ptr<U>::destroy(inner_); }
 
-    D& operator*() noexcept override { return *ptr_; }
+    pmr_concept* clone() const override
+    {
+      auto inner = inner_->clone();
+
+      VP_TRY
+      {
+        return new pmr_adapter<U>(inner);
+      }
+      VP_CATCH_ALL
+      {
+        value_ptr<U>::destroy(inner);
+        VP_RETHROW;
+      }
+      return nullptr;
+    }
+
+    pmr_concept* try_clone() const override
+    {
+      auto inner = inner_->try_clone();
+      if (!inner) {
+        return nullptr;
+      }
 
-    D* release() noexcept override
+      auto adapter = new (std::nothrow) pmr_adapter<U>(inner);
+      if (!adapter) {
+        value_ptr<U>::destroy(inner);
+      }
+      return adapter;
+    }
+
+    T* release() override
     {
-      auto ptr = ptr_;
-      ptr_ = nullptr;
+      auto ptr = release_object(detail::can_static_cast<U*, T*>{});
+      value_ptr<U>::destroy(inner_);
+      inner_ = nullptr;
+      this->ptr_ = nullptr;
       return ptr;
     }
 
-    D* ptr_;
+    T* release_object(std::true_type)
+    {
+      return static_cast<T*>(inner_->release());
+    }
+
+    // The released pointer would be to a virtual base of T, which can't be
+    // converted back; move the object out through its exact address instead.
+    T* release_object(std::false_type)
+    {
+      return detail::new_released(std::move(*this->ptr_));
+    }
+
+    bool assign(
+        detail::type_descriptor const* type, void const* object) override
+    {
+      return inner_->assign(type, object);
+    }
+
+    void const* object() const noexcept override { return inner_->object(); }
+
+    detail::model_base* unwrap(
+        detail::type_descriptor const* target) noexcept override
+    {
+      if (target != &detail::type_of<inner_concept>::value) {
+        return nullptr;
+      }
+
+      auto inner = inner_;
+      inner_ = nullptr;
+      return inner;
+    }
+
+    std::size_t capacity() const noexcept override { return sizeof(*this); }
+
+    std::size_t alignment() const noexcept override
+    {
+      return alignof(pmr_adapter);
+    }
+
+    std::size_t deep_size() const override
+    {
+      return sizeof(*this) + inner_->deep_size();
+    }
+
+    inner_concept* inner_;
   };
 
 public:
@@ -86,24 +1382,106 @@ public:
   template <typename U,
       typename
       = typename std::enable_if<std::is_convertible<U*, pointer>::value>>
-  explicit value_ptr(U* ptr) noexcept
-      : impl_(new pmr_model<U>(ptr))
+  VP_CONSTEXPR20 explicit value_ptr(U* ptr)
+      : impl_(ptr ? new_adopted<U>(ptr) : nullptr)
+  {
+  }
+
+  /**
+   * Construct a value_ptr from a unique_ptr, taking ownership of its object.
+   *
+   * The object is not copied or moved, and is eventually freed using the
+   * unique_ptr's deleter. Copies of this value_ptr are allocated by the
+   * library, and don't use the deleter.
+   */
+  template <typename U, typename Deleter,
+      typename = typename std::enable_if<
+          std::is_convertible<U*, pointer>::value
+          && std::is_same<typename std::unique_ptr<U, Deleter>::pointer,
+              U*>::value>::type>
+  value_ptr(std::unique_ptr<U, Deleter>&& ptr)
+      : impl_(ptr ? new pmr_model<U, Deleter>(std::move(ptr)) : nullptr)
+  {
+  }
+
+  /**
+   * Construct an object of type D in place, forwarding args to its
+   * constructor.
+   *
+   * The object is stored in the same allocation as the bookkeeping needed to
+   * copy it, so this costs one allocation rather than the two needed to adopt
+   * a pointer from new.
+   */
+  template <typename D, typename... Args,
+      typename
+      = typename std::enable_if<std::is_convertible<D*, pointer>::value>::type>
+  VP_CONSTEXPR20 explicit value_ptr(in_place_type_t<D>, Args&&... args)
+      : impl_(new_inline<D>(std::forward<Args>(args)...))
+  {
+  }
+
+  /**
+   * Construct an object of type D in place as above, leaving the value_ptr
+   * empty rather than throwing if there is no memory for it (see
+   * try_make_val).
+   */
+  template <typename D, typename... Args,
+      typename
+      = typename std::enable_if<std::is_convertible<D*, pointer>::value>::type>
+  value_ptr(std::nothrow_t const&, in_place_type_t<D>, Args&&... args)
+      : impl_(new (std::nothrow) pmr_inline_model<D>(
+          std::forward<Args>(args)...))
+  {
+  }
+
+  /**
+   * Construct an object of type D in place as above, aligned to and padded
+   * out to a whole number of cache lines.
+   *
+   * Objects written to by different threads should not share a cache line,
+   * or each write invalidates the line in the other threads' caches. Copies
+   * of the object are aligned in the same way.
+   */
+  template <typename D, typename... Args,
+      typename
+      = typename std::enable_if<std::is_convertible<D*, pointer>::value>::type>
+  value_ptr(cache_aligned_t, in_place_type_t<D>, Args&&... args)
+      : impl_(new pmr_inline_model<D, VP_CACHE_LINE_SIZE>(
+          std::forward<Args>(args)...))
+  {
+  }
+
+  /**
+   * Construct an object of type D in place as above, in a block allocated
+   * from arena (see value_ptr/arena.h).
+   *
+   * Copies of the object are allocated from the same arena, which must outlive
+   * every value_ptr that uses it.
+   */
+  template <typename Arena, typename D, typename... Args,
+      typename = typename std::enable_if<detail::is_model_arena<Arena>::value
+          && std::is_convertible<D*, pointer>::value>::type>
+  value_ptr(Arena& arena, in_place_type_t<D>, Args&&... args)
+      : impl_(new (arena) pmr_arena_model<D, Arena>(
+          arena, std::forward<Args>(args)...))
   {
   }
 
   /**
    * Construct a value_ptr from another value_ptr.
+   *
+   * The object managed by other keeps its dynamic type, and is not copied
+   * again after other itself has been constructed (so converting from an
+   * rvalue does not copy the object at all).
    */
   template <typename U,
       typename = typename std::enable_if<
           std::is_convertible<typename value_ptr<U>::pointer, pointer>::value
           && !std::is_same<T, U>::value>::type>
-  value_ptr(value_ptr<U> other) noexcept(
-      std::is_nothrow_copy_constructible<U>::value)
+  value_ptr(value_ptr<U> other)
+      : impl_(other ? new pmr_adapter<U>(other.impl_) : nullptr)
   {
-    auto clone = other.impl_->clone();
-    impl_ = new pmr_model<U>(clone->release());
-    delete clone;
+    other.impl_ = nullptr;
   }
 
   /**
@@ -121,29 +1499,70 @@ public:
   constexpr value_ptr() noexcept
       : value_ptr(nullptr)
   {
-  }
+  }
+
+  VP_COPY_SITE VP_CONSTEXPR20 value_ptr(value_ptr<T> const& other)
+      : impl_(nullptr)
+  {
+    if (other.impl_) {
+      impl_ = clone(other.impl_, enable_iterative_ownership<T>{});
+#if defined(VP_PROFILE_COPIES)
+      if (!detail::is_constant_evaluated()) {
+        detail::record_copy(VP_RETURN_ADDRESS(), deep_size());
+      }
+#endif
+    }
+  }
+
+  /**
+   * Copy the object managed by other into this one.
+   *
+   * If both objects have the same dynamic type (of at most 4KB), other's object
+   * is copied onto the stack and move-assigned to this one's, which reuses
+   * this one's allocation. The copy is taken first, so other may be owned by
+   * this object (as in `head = head->next`). If the copy throws, this object
+   * is unchanged; if the assignment throws, the managed object is left in
+   * whatever state that type's assignment operator leaves it in.
+   *
+   * Otherwise, a copy of other's object replaces this one's. Types with
+   * iterative ownership always take this path, as assigning in place would
+   * recurse through their members, and so does constant evaluation.
+   */
+  VP_COPY_SITE VP_CONSTEXPR20 value_ptr<T>& operator=(
+      value_ptr<T> const& other)
+  {
+    if (enable_iterative_ownership<T>::value || detail::is_constant_evaluated()
+        || !impl_ || !other.impl_
+        || !impl_->assign(other.impl_->type_, other.impl_->object())) {
+      auto copy = value_ptr<T>();
+      if (other.impl_) {
+        copy.impl_ = copy.clone(other.impl_,
+            enable_iterative_ownership<T>{}, &pmr_concept::clone, false);
+      }
+      copy.swap(*this);
+    }
 
-  value_ptr(value_ptr<T> const& other) noexcept(
-      std::is_nothrow_copy_constructible<T>::value)
-      : impl_(other.impl_ ? other.impl_->clone() : nullptr)
-  {
+#if defined(VP_PROFILE_COPIES)
+    if (impl_ && !detail::is_constant_evaluated()) {
+      detail::record_copy(VP_RETURN_ADDRESS(), deep_size());
+    }
+#endif
+    return *this;
   }
 
-  value_ptr<T>& operator=(value_ptr<T> other) noexcept
+  VP_CONSTEXPR20 value_ptr<T>& operator=(value_ptr<T>&& other) noexcept
   {
-    using std::swap;
-    swap(*this, other);
+    value_ptr<T>(std::move(other)).swap(*this);
     return *this;
   }
 
-  value_ptr(value_ptr<T>&& other) noexcept
+  VP_CONSTEXPR20 value_ptr(value_ptr<T>&& other) noexcept
       : impl_(std::move(other.impl_))
   {
     other.impl_ = nullptr;
   }
 
-  value_ptr<T>& operator=(std::nullptr_t) noexcept(
-      noexcept(std::declval<value_ptr<T>>().reset()))
+  VP_CONSTEXPR20 value_ptr<T>& operator=(std::nullptr_t) noexcept
   {
     reset();
     return *this;
@@ -152,33 +1571,84 @@ public:
   /**
    * Destroys the stored value if it exists.
    */
-  ~value_ptr() noexcept(std::is_nothrow_destructible<T>::value)
+  VP_CONSTEXPR20 ~value_ptr() noexcept
   {
     if (impl_) {
-      delete impl_;
+      destroy(impl_);
     }
   }
 
   /*
    * Get the underlying raw pointer.
    */
-  T* get() const noexcept { return impl_->get(); }
+  VP_CONSTEXPR20 T* get() const noexcept
+  {
+    return impl_ ? impl_->ptr_ : nullptr;
+  }
 
   /*
    * Arrow operator returns the underlying raw pointer for chaining.
    */
-  T* operator->() const noexcept { return impl_->get(); }
+  VP_CONSTEXPR20 T* operator->() const noexcept
+  {
+    record_type();
+    return impl_->ptr_;
+  }
 
   /*
    * Dereferences the underlying raw pointer.
    */
-  T& operator*() const noexcept { return **impl_; }
+  VP_CONSTEXPR20 T& operator*() const noexcept
+  {
+    record_type();
+    return *impl_->ptr_;
+  }
+
+  /**
+   * Call f with the managed object, as a D& if its dynamic type is exactly D
+   * and as a T& otherwise, returning the result.
+   *
+   * When one dynamic type dominates, this lets the common case be compiled
+   * against the concrete type: checking for it costs one comparison, and
+   * calls to final members of D made by f need no virtual dispatch. The
+   * value_ptr must not be empty.
+   */
+  template <typename D, typename F>
+  auto with_likely(F&& f) const -> decltype(f(std::declval<T&>()))
+  {
+    record_type();
+
+    if (VP_LIKELY(impl_->type_ == &detail::type_of<D>::value)) {
+      return f(*detail::object_cast<D>(impl_->ptr_, impl_));
+    }
+
+    return f(*impl_->ptr_);
+  }
 
   /*
    * Conversion to bool (true if an underlying raw pointer is stored, false
    * otherwise).
    */
-  explicit operator bool() const noexcept { return static_cast<bool>(impl_); }
+  VP_CONSTEXPR20 explicit operator bool() const noexcept
+  {
+    return static_cast<bool>(impl_);
+  }
+
+  /**
+   * The number of bytes of memory owned by this value_ptr, or zero if it is
+   * empty.
+   *
+   * This counts the object and the bookkeeping allocated with it (or
+   * separately, if the object was adopted from a pointer), but not the
+   * value_ptr itself. Memory the object owns in turn is included if a
+   *
+   *     std::size_t deep_size_members(D const&);
+   *
+   * overload for its dynamic type D can be found by argument-dependent lookup.
+   * That typically adds up deep_size of the object's own value_ptr members and
+   * the capacity of its other containers.
+   */
+  std::size_t deep_size() const { return impl_ ? impl_->deep_size() : 0; }
 
   /**
    * Get the underlying raw pointer and release ownership.
@@ -186,11 +1656,24 @@ public:
    * After calling, this object will be in a reset state (i.e. modelling a null
    * pointer). The returned pointer is no longer owned by this object and must
    * be managed by the caller.
+   *
+   * Only an object adopted from a pointer (or from a unique_ptr with the
+   * default deleter) is handed back as is. An object constructed in place
+   * (including by make_val) or copied from another value_ptr shares an
+   * allocation with internal bookkeeping, so it is moved into a new allocation
+   * (or copied, if its move constructor is deleted) and the returned pointer
+   * differs from get(). That allocation is made with new, so before C++17 it
+   * is only aligned to alignof(std::max_align_t) whatever the alignment of the
+   * object's type, and it may throw.
    */
-  T* release() noexcept
+  T* release()
   {
+    if (!impl_) {
+      return nullptr;
+    }
+
     auto ptr = impl_->release();
-    delete impl_;
+    destroy(impl_);
     impl_ = nullptr;
     return ptr;
   }
@@ -200,31 +1683,72 @@ public:
    *
    * A call to reset while this object is managing an object will cause the
    * managed object to be destroyed. After calling, this object will manage ptr.
+   *
+   * If the bookkeeping for the old object is large enough to be reused for
+   * ptr, this does not allocate.
    */
   template <typename U>
-  void reset(U* ptr) noexcept(std::is_nothrow_destructible<T>::value&&
-          std::is_nothrow_copy_constructible<U>::value)
+  VP_CONSTEXPR20 void reset(U* ptr)
   {
-    delete impl_;
-
-    if (ptr) {
-      impl_ = new pmr_model<U>(ptr);
+    if (detail::is_constant_evaluated()) {
+      value_ptr<T>(ptr).swap(*this);
+    } else if (ptr) {
+      replace<pmr_model<U>>(ptr);
     } else {
-      impl_ = nullptr;
+      reset();
     }
   }
 
-  void reset(std::nullptr_t = nullptr) noexcept(
-      std::is_nothrow_destructible<T>::value)
+  VP_CONSTEXPR20 void reset(std::nullptr_t = nullptr) noexcept
   {
-    delete impl_;
+    destroy(impl_);
     impl_ = nullptr;
   }
 
+  /**
+   * Replace the managed object with one of type D constructed in place,
+   * forwarding args to its constructor. Returns a reference to the new object.
+   *
+   * If the allocation holding the old object is large enough for the new one,
+   * it is reused: the old object is destroyed and the new one is constructed
+   * in its place, so args must not refer to the old object. If constructing
+   * the new object then throws, this value_ptr is left empty.
+   */
+  template <typename D = T, typename... Args>
+  VP_CONSTEXPR20 D& emplace(Args&&... args)
+  {
+    static_assert(std::is_convertible<D*, pointer>::value,
+        "emplaced type must be convertible to the element type");
+
+#if VP_HAS_CONSTEXPR20
+    if (std::is_constant_evaluated()) {
+      auto model = new pmr_constexpr_model<D>(std::forward<Args>(args)...);
+      auto old = impl_;
+      impl_ = model;
+      destroy(old);
+      return model->obj_;
+    }
+#endif
+    return replace<pmr_inline_model<D>>(std::forward<Args>(args)...)->obj_;
+  }
+
+  /**
+   * Check whether the dynamic type of the managed object is exactly D.
+   *
+   * This compares a single pointer stored alongside the object, so is much
+   * cheaper than a dynamic_cast. Unlike dynamic_cast, it does not match types
+   * derived from D.
+   */
+  template <typename D>
+  VP_CONSTEXPR20 bool holds() const noexcept
+  {
+    return impl_ && impl_->type_ == &detail::type_of<D>::value;
+  }
+
   /**
    * Specialization to enable ADL swap.
    */
-  void swap(value_ptr<T>& other) noexcept
+  VP_CONSTEXPR20 void swap(value_ptr<T>& other) noexcept
   {
     using std::swap;
     swap(impl_, other.impl_);
@@ -234,16 +1758,327 @@ public:
    * Get a uniquely owning pointer to the managed object.
    *
    * After calling, this object will be reset as if release had been called.
+   * In particular, an object adopted from a pointer or from a unique_ptr with
+   * the default deleter is handed back without being copied or moved.
    */
-  std::unique_ptr<T> to_unique() noexcept
+  std::unique_ptr<T> to_unique()
   {
     return std::unique_ptr<T>(release());
   }
 
+  /**
+   * Deep-copy the managed object, returning an empty value_ptr rather than
+   * throwing if there is no memory for the copy.
+   *
+   * Only the allocation made here is checked: the object's copy constructor
+   * may still throw (or without exceptions, abort) if it allocates in turn,
+   * e.g. to copy value_ptr members.
+   */
+  value_ptr<T> try_clone() const
+  {
+    auto copy = value_ptr<T>();
+    if (impl_) {
+      copy.impl_ = copy.clone(impl_, enable_iterative_ownership<T>{},
+          &pmr_concept::try_clone, false);
+    }
+    return copy;
+  }
+
 protected:
+  VP_CONSTEXPR20 void record_type() const
+  {
+#if defined(VP_PROFILE_TYPES)
+    if (!detail::is_constant_evaluated()) {
+      detail::record_type<T>(impl_->type_);
+    }
+#endif
+  }
+
+  /**
+   * Allocate a model holding an object of type D constructed from args.
+   */
+  template <typename D, typename... Args>
+  static VP_CONSTEXPR20 pmr_concept* new_inline(Args&&... args)
+  {
+#if VP_HAS_CONSTEXPR20
+    if (std::is_constant_evaluated()) {
+      return new pmr_constexpr_model<D>(std::forward<Args>(args)...);
+    }
+#endif
+    return new pmr_inline_model<D>(std::forward<Args>(args)...);
+  }
+
+  /**
+   * Allocate a model that adopts ptr.
+   */
+  template <typename U>
+  static VP_CONSTEXPR20 pmr_concept* new_adopted(U* ptr)
+  {
+#if VP_HAS_CONSTEXPR20
+    if (std::is_constant_evaluated()) {
+      return new pmr_constexpr_adopted_model<U>(ptr);
+    }
+#endif
+    return new pmr_model<U>(ptr);
+  }
+
+  /**
+   * Replace the current model with a model of type M constructed from args,
+   * reusing the current model's block if it is large enough.
+   */
+  template <typename M, typename... Args>
+  M* replace(Args&&... args)
+  {
+    if (impl_ && alignof(M) == impl_->alignment()) {
+      auto old = impl_;
+      impl_ = nullptr;
+
+      // Nothing is moved from args unless the model is built here.
+      if (auto model = rebuild<M>(
+              old, old->capacity(), std::forward<Args>(args)...)) {
+        impl_ = model;
+        return model;
+      }
+
+      impl_ = old;
+    }
+
+    auto model = new M(std::forward<Args>(args)...);
+    auto old = impl_;
+    impl_ = model;
+    destroy(old);
+    return model;
+  }
+
+  /**
+   * If M fits in capacity bytes, destroy the model at block and construct a
+   * model of type M from args in its place, freeing the block if that throws.
+   * Otherwise, return null and leave the block alone.
+   *
+   * This is kept out of line so that the compiler only sees the block as raw
+   * memory of a size known at run time. Inlined into a caller that allocated
+   * the old model, it would see a smaller model being overwritten by a larger
+   * one on a path it can't prove is dead, and warn about it.
+   */
+  template <typename M, typename... Args>
+  static VP_NOINLINE M* rebuild(
+      void* block, std::size_t capacity, Args&&... args)
+  {
+    if (sizeof(M) > capacity) {
+      return nullptr;
+    }
+
+    static_cast<pmr_concept*>(block)->~pmr_concept();
+
+    VP_TRY
+    {
+      return ::new (block) M(std::forward<Args>(args)...);
+    }
+    VP_CATCH_ALL
+    {
+      detail::deallocate(block, alignof(M));
+      VP_RETHROW;
+    }
+    return nullptr;
+  }
+
+  using clone_function = pmr_concept* (pmr_concept::*)() const;
+
+  static VP_CONSTEXPR20 pmr_concept* clone(pmr_concept* model,
+      std::false_type, clone_function clone_root = &pmr_concept::clone,
+      bool /* defer */ = true)
+  {
+    return (model->*clone_root)();
+  }
+
+  /**
+   * Clone a model iteratively (see enable_iterative_ownership).
+   *
+   * Copies of nested value_ptrs made while another clone is running leave
+   * their destination null and are queued instead; the outermost call then
+   * drains the queue. A destination that might not live that long (such as
+   * the temporary in copy assignment) passes defer = false, and is completed
+   * before this returns, along with everything queued while cloning it. On
+   * failure, everything cloned so far by this call is destroyed. The root
+   * model is cloned with clone_root, and nested ones with clone.
+   */
+  VP_CONSTEXPR20 pmr_concept* clone(pmr_concept* model, std::true_type,
+      clone_function clone_root = &pmr_concept::clone, bool defer = true)
+  {
+    // Compile-time copies are bounded by the constexpr step limit anyway.
+    if (detail::is_constant_evaluated()) {
+      return (model->*clone_root)();
+    }
+
+    auto& list = detail::clone_worklist();
+
+    if (list.active && defer) {
+      list.pending.push_back({ &impl_, model, &run_clone });
+      return nullptr;
+    }
+
+    // Work queued below mark belongs to an enclosing clone.
+    auto const outer = list.active;
+    auto const mark = list.pending.size();
+    list.active = true;
+    pmr_concept* root = nullptr;
+
+    VP_TRY
+    {
+      root = (model->*clone_root)();
+
+      while (list.pending.size() > mark) {
+        auto next = list.pending.back();
+        list.pending.pop_back();
+        next.run(next.dest, next.src);
+      }
+    }
+    VP_CATCH_ALL
+    {
+      list.pending.erase(list.pending.begin() + mark, list.pending.end());
+      list.active = outer;
+      destroy(root);
+      VP_RETHROW;
+    }
+
+    list.active = outer;
+    return root;
+  }
+
+  static void run_clone(void* dest, detail::model_base* src)
+  {
+    *static_cast<pmr_concept**>(dest)
+        = static_cast<pmr_concept*>(src)->clone();
+  }
+
+  static VP_CONSTEXPR20 void destroy(pmr_concept* model) noexcept
+  {
+    if (enable_iterative_ownership<T>::value
+        && !detail::is_constant_evaluated()) {
+      detail::destroy_iteratively(model);
+    } else {
+      delete model;
+    }
+  }
+
   pmr_concept* impl_;
 };
 
+namespace detail {
+
+struct access {
+  /**
+   * Take ownership of the model managed by ptr, leaving ptr null.
+   */
+  template <typename T>
+  static model_base* release_model(value_ptr<T>& ptr) noexcept
+  {
+    model_base* model = ptr.impl_;
+    ptr.impl_ = nullptr;
+    return model;
+  }
+
+  /**
+   * Take ownership of the model managed by the non-empty ptr, leaving ptr
+   * null, and return its queue hook (see enable_queue_hook).
+   */
+  template <typename T>
+  static queue_hook* release_hook(value_ptr<T>& ptr) noexcept
+  {
+    queue_hook* hook = ptr.impl_;
+    ptr.impl_ = nullptr;
+    return hook;
+  }
+
+  /**
+   * Construct a value_ptr that owns the model with the given queue hook, as
+   * returned by release_hook.
+   */
+  template <typename T>
+  static value_ptr<T> adopt_hook(queue_hook* hook) noexcept
+  {
+    auto ptr = value_ptr<T>();
+    ptr.impl_ = static_cast<typename value_ptr<T>::pmr_concept*>(hook);
+    return ptr;
+  }
+
+  /**
+   * The dynamic type of the object managed by the non-empty ptr.
+   */
+  template <typename T>
+  static type_descriptor const* dynamic_type(value_ptr<T> const& ptr) noexcept
+  {
+    return ptr.impl_->type_;
+  }
+
+  /**
+   * Get the object managed by ptr, whose dynamic type must be exactly D.
+   */
+  template <typename D, typename T>
+  static D* object_as(value_ptr<T> const& ptr) noexcept
+  {
+    return object_cast<D>(ptr.impl_->ptr_, ptr.impl_);
+  }
+
+  /**
+   * Move the model managed by ptr, whose dynamic type must be exactly D, into
+   * a value_ptr<D> without copying the object.
+   */
+  template <typename D, typename T>
+  static value_ptr<D> adapt(value_ptr<T>& ptr, std::true_type) noexcept
+  {
+    return std::move(ptr);
+  }
+
+  template <typename D, typename T>
+  static value_ptr<D> adapt(value_ptr<T>& ptr, std::false_type)
+  {
+    using target = typename value_ptr<D>::pmr_concept;
+    auto result = value_ptr<D>();
+
+    if (auto inner = ptr.impl_->unwrap(&type_of<target>::value)) {
+      // ptr was itself converted from a value_ptr<D>, so its original model
+      // can be used directly.
+      result.impl_ = static_cast<target*>(inner);
+      value_ptr<T>::destroy(ptr.impl_);
+    } else {
+      using adapter = typename value_ptr<D>::template pmr_adapter<T>;
+      result.impl_ = new adapter(ptr.impl_);
+    }
+
+    ptr.impl_ = nullptr;
+    return result;
+  }
+};
+
+} // namespace detail
+
+/**
+ * Get the object managed by ptr as its dynamic type D, or null if ptr is empty
+ * or the dynamic type of its object is not exactly D (see value_ptr::holds).
+ */
+template <typename D, typename T>
+D* value_ptr_cast(value_ptr<T> const& ptr) noexcept
+{
+  return ptr.template holds<D>() ? detail::access::object_as<D>(ptr) : nullptr;
+}
+
+/**
+ * Transfer ownership of the object managed by ptr to a value_ptr<D> if its
+ * dynamic type is exactly D. The object is not copied or moved.
+ *
+ * Otherwise, ptr is left unchanged and an empty value_ptr<D> is returned.
+ */
+template <typename D, typename T>
+value_ptr<D> value_ptr_cast(value_ptr<T>&& ptr)
+{
+  if (!ptr.template holds<D>()) {
+    return value_ptr<D>();
+  }
+
+  return detail::access::adapt<D>(ptr, std::is_same<D, T>{});
+}
+
 template <typename T1, typename T2>
 bool operator==(value_ptr<T1> const& a, value_ptr<T2> const& b) noexcept
 {
@@ -354,24 +2189,163 @@ bool operator>=(std::nullptr_t, value_ptr<T> const& a) noexcept
   return !(nullptr < a);
 }
 
+namespace detail {
+
+/**
+ * The address held by a raw or smart pointer, converted to a pointer to the
+ * key type T (adjusting it if T is a base class of the pointee).
+ */
+template <typename T>
+T const* key_address(T const* ptr) noexcept
+{
+  return ptr;
+}
+
+template <typename T, typename U>
+T const* key_address(value_ptr<U> const& ptr) noexcept
+{
+  return ptr.get();
+}
+
+template <typename T, typename U, typename Deleter>
+T const* key_address(std::unique_ptr<U, Deleter> const& ptr) noexcept
+{
+  return ptr.get();
+}
+
+} // namespace detail
+
+/**
+ * Transparent ordering of value_ptr<T> keys by address, which also accepts raw
+ * pointers, unique_ptrs and value_ptrs to T or to classes derived from it.
+ *
+ * With std::set<value_ptr<T>, value_ptr_less<T>> (or std::map), find and the
+ * other lookup functions can be given any of these from C++14 onwards, without
+ * constructing a temporary value_ptr.
+ */
+template <typename T>
+struct value_ptr_less {
+  using is_transparent = void;
+
+  template <typename A, typename B>
+  bool operator()(A const& a, B const& b) const noexcept
+  {
+    return std::less<T const*>()(
+        detail::key_address<T>(a), detail::key_address<T>(b));
+  }
+};
+
+/**
+ * Transparent hash of value_ptr<T> keys by address, accepting the same
+ * arguments as value_ptr_less. It agrees with std::hash<value_ptr<T>>.
+ *
+ * Unordered containers use it for lookups from C++20 onwards, together with
+ * value_ptr_equal. As keys are identified by address, and a copy of a
+ * value_ptr has a new one, they should be inserted by moving: a container may
+ * hash the argument to insert rather than the copy of it that it stores.
+ */
+template <typename T>
+struct value_ptr_hash {
+  using is_transparent = void;
+
+  template <typename A>
+  std::size_t operator()(A const& a) const noexcept
+  {
+    return std::hash<T*>()(const_cast<T*>(detail::key_address<T>(a)));
+  }
+};
+
+/**
+ * Transparent equality of value_ptr<T> keys by address, accepting the same
+ * arguments as value_ptr_less.
+ */
+template <typename T>
+struct value_ptr_equal {
+  using is_transparent = void;
+
+  template <typename A, typename B>
+  bool operator()(A const& a, B const& b) const noexcept
+  {
+    return detail::key_address<T>(a) == detail::key_address<T>(b);
+  }
+};
+
 template <typename T>
-void swap(value_ptr<T>& a, value_ptr<T>& b) noexcept
+VP_CONSTEXPR20 void swap(value_ptr<T>& a, value_ptr<T>& b) noexcept
 {
   a.swap(b);
 }
 
+/**
+ * Construct a value_ptr that takes ownership of the object managed by ptr.
+ */
+template <typename T, typename Deleter>
+value_ptr<T> from_unique(std::unique_ptr<T, Deleter>&& ptr)
+{
+  return value_ptr<T>(std::move(ptr));
+}
+
+template <typename T, typename... Args>
+VP_CONSTEXPR20 value_ptr<T> make_val(Args&&... args)
+{
+  return value_ptr<T>(in_place_type_t<T>{}, std::forward<Args>(args)...);
+}
+
+/**
+ * As make_val, but returns an empty value_ptr rather than throwing if there is
+ * no memory for the object.
+ */
 template <typename T, typename... Args>
-value_ptr<T> make_val(Args&&... args)
+value_ptr<T> try_make_val(Args&&... args)
 {
-  return value_ptr<T>(new T(std::forward<Args>(args)...));
+  return value_ptr<T>(
+      std::nothrow, in_place_type_t<T>{}, std::forward<Args>(args)...);
 }
 
 template <typename Base, typename Derived, typename... Args>
-typename std::enable_if<std::is_base_of<Base, Derived>::value,
+VP_CONSTEXPR20 typename std::enable_if<std::is_base_of<Base, Derived>::value,
     value_ptr<Base>>::type
 make_derived_val(Args&&... args)
 {
-  return value_ptr<Base>(new Derived(std::forward<Args>(args)...));
+  return value_ptr<Base>(
+      in_place_type_t<Derived>{}, std::forward<Args>(args)...);
+}
+
+template <typename T, typename... Args>
+value_ptr<T> make_cache_aligned_val(Args&&... args)
+{
+  return value_ptr<T>(
+      cache_aligned, in_place_type_t<T>{}, std::forward<Args>(args)...);
+}
+
+template <typename T, typename Arena, typename... Args>
+value_ptr<T> make_arena_val(Arena& arena, Args&&... args)
+{
+  return value_ptr<T>(
+      arena, in_place_type_t<T>{}, std::forward<Args>(args)...);
+}
+
+/**
+ * The number of bytes of memory owned by ptr (see value_ptr::deep_size).
+ */
+template <typename T>
+std::size_t deep_size(value_ptr<T> const& ptr)
+{
+  return ptr.deep_size();
+}
+
+/**
+ * The total number of bytes of memory owned by the value_ptrs in the range
+ * [first, last), not counting the storage of the range itself.
+ */
+template <typename InputIt>
+std::size_t deep_size(InputIt first, InputIt last)
+{
+  auto size = std::size_t(0);
+  for (; first != last; ++first) {
+    size += first->deep_size();
+  }
+  return size;
 }
 
 } // namespace bsc
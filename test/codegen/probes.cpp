@@ -0,0 +1,38 @@
+// Probe functions for the codegen tests; run.sh compiles this file to
+// assembly and checks the code generated for each function.
+#include <value_ptr/value_ptr.h>
+
+#include <new>
+
+struct shape {
+  virtual ~shape() = default;
+  virtual int sides() const = 0;
+};
+
+using ptr = bsc::value_ptr<shape>;
+
+extern "C" {
+
+shape* probe_get(ptr const& p) { return p.get(); }
+
+shape& probe_deref(ptr const& p) { return *p; }
+
+bool probe_bool(ptr const& p) { return static_cast<bool>(p); }
+
+void probe_move_construct(void* dest, ptr& src)
+{
+  ::new (dest) ptr(std::move(src));
+}
+
+void probe_move_assign(ptr& dest, ptr& src) { dest = std::move(src); }
+
+void probe_swap(ptr& a, ptr& b) { a.swap(b); }
+
+void probe_destroy_null() { ptr p; }
+
+void probe_destroy_moved_from(ptr& src)
+{
+  auto p = std::move(src);
+  ::new (&src) ptr(std::move(p));
+}
+}
@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Compiles probes.cpp at -O2 and checks the assembly generated for each probe
+# function against a budget: the most instructions it may contain, and how
+# many direct calls (including tail calls) and indirect calls or jumps it may
+# make.
+
+CXX=@CMAKE_CXX_COMPILER@
+INCLUDE=@VP_INCLUDE_DIR@
+PROBES=@CMAKE_CURRENT_SOURCE_DIR@/probes.cpp
+FLAGS="@VP_CODEGEN_FLAGS@"
+
+# name                     instructions  calls  indirect
+BUDGETS="
+probe_get                  5             0      0
+probe_deref                3             0      0
+probe_bool                 3             0      0
+probe_move_construct       4             0      0
+probe_move_assign          12            0      1
+probe_swap                 5             0      0
+probe_destroy_null         1             0      0
+probe_destroy_moved_from   1             0      0
+"
+
+ASM=$($CXX -std=c++11 -O2 -S -fno-asynchronous-unwind-tables $FLAGS \
+  "-I$INCLUDE" "$PROBES" -o -)
+if [ $? -ne 0 ]; then
+  echo "failed to compile $PROBES"
+  exit 1
+fi
+
+STATUS=0
+
+while read -r name max_insns max_calls max_indirect; do
+  if [ -z "$name" ]; then
+    continue
+  fi
+
+  # Instructions are the tab-indented lines between the function's label and
+  # the next function, other than assembler directives. Mach-O prefixes
+  # symbols with an underscore, and local labels start with L rather than .L.
+  counts=$(echo "$ASM" | awk -v fn="$name" '
+    $0 == fn ":" || $0 == "_" fn ":" { inside = 1; next }
+    inside && /^[A-Za-z_][A-Za-z0-9_.]*:/ && !/^L/ { inside = 0 }
+    inside && /^\t\.size/ { inside = 0 }
+    inside && /^\t[a-z]/ {
+      insns++
+      if ($1 ~ /^(call|jmp)/ && $2 ~ /^\*/) indirect++
+      else if ($1 ~ /^call/ || ($1 ~ /^jmp/ && $2 !~ /^\.?L/)) calls++
+    }
+    END { print insns + 0, calls + 0, indirect + 0 }')
+
+  read -r insns calls indirect <<< "$counts"
+
+  if [ "$insns" -eq 0 ]; then
+    echo "$name: not found in the generated assembly"
+    STATUS=1
+  elif [ "$insns" -gt "$max_insns" ] || [ "$calls" -gt "$max_calls" ] \
+      || [ "$indirect" -gt "$max_indirect" ]; then
+    echo "$name: $insns instructions, $calls calls, $indirect indirect" \
+      "(budget $max_insns, $max_calls, $max_indirect)"
+    echo "$ASM" | awk -v fn="$name" '
+      $0 == fn ":" || $0 == "_" fn ":" { inside = 1; print; next }
+      inside && /^[A-Za-z_][A-Za-z0-9_.]*:/ && !/^L/ { exit }
+      inside && /^\t\.size/ { exit }
+      inside { print }'
+    STATUS=1
+  else
+    echo "$name: $insns instructions, $calls calls, $indirect indirect"
+  fi
+done <<< "$BUDGETS"
+
+exit $STATUS
@@ -0,0 +1,7 @@
+#include <value_ptr/explicit_copy.h>
+
+void f()
+{
+  auto a = bsc::make_explicit_val<int>(1);
+  auto b = a;
+}
@@ -0,0 +1,7 @@
+#include <value_ptr/fast_pimpl.h>
+
+struct impl {
+  char data[64];
+};
+
+void f() { bsc::fast_pimpl<impl, 32> p; }
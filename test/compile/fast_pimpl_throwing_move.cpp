@@ -0,0 +1,11 @@
+#include <value_ptr/fast_pimpl.h>
+
+struct impl {
+  impl() = default;
+  impl(impl const&) = default;
+  impl(impl&&) noexcept = default;
+  impl& operator=(impl const&) = default;
+  impl& operator=(impl&&) { return *this; }
+};
+
+void f() { bsc::fast_pimpl<impl, 32> p; }
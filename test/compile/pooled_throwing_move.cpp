@@ -0,0 +1,11 @@
+#include <value_ptr/pooled.h>
+
+struct value {
+  value() = default;
+  value(value const&) = default;
+  value(value&&) noexcept = default;
+  value& operator=(value const&) = default;
+  value& operator=(value&&) { return *this; }
+};
+
+void f() { bsc::value_pool<value>::instance().erase(1); }
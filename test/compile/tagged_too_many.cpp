@@ -0,0 +1,13 @@
+#include <value_ptr/tagged.h>
+
+struct base {
+  char c;
+};
+
+struct d1 : base {
+};
+
+struct d2 : base {
+};
+
+void f() { bsc::tagged_value_ptr<base, base, d1, d2> p; }
@@ -0,0 +1,399 @@
+#include "catch.hpp"
+
+#include <value_ptr/fast_pimpl.h>
+#include <value_ptr/mpsc_queue.h>
+#include <value_ptr/retire.h>
+#include <value_ptr/value_ptr.h>
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace bsc;
+
+// Every allocation made by this test executable is counted, so that the
+// number of allocations made by each value_ptr operation can be checked.
+namespace {
+
+std::size_t allocations = 0;
+std::size_t deallocations = 0;
+
+void* counted_allocate(std::size_t size, std::nothrow_t const&) noexcept
+{
+  ++allocations;
+  return std::malloc(size ? size : 1);
+}
+
+void* counted_allocate(std::size_t size)
+{
+  if (auto ptr = counted_allocate(size, std::nothrow)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc();
+}
+
+void counted_free(void* ptr) noexcept
+{
+  if (ptr) {
+    ++deallocations;
+    std::free(ptr);
+  }
+}
+
+struct budget {
+  std::size_t allocs;
+  std::size_t frees;
+
+  bool operator==(budget const& o) const
+  {
+    return allocs == o.allocs && frees == o.frees;
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, budget const& b)
+{
+  return os << "{ allocs: " << b.allocs << ", frees: " << b.frees << " }";
+}
+
+template <typename Func>
+budget measure(Func&& f)
+{
+  auto allocs = allocations;
+  auto frees = deallocations;
+  f();
+  return { allocations - allocs, deallocations - frees };
+}
+
+struct Base {
+  virtual ~Base() = default;
+  virtual int val() const { return 0; }
+};
+
+struct Derived : Base {
+  Derived(int v)
+      : v_(v)
+  {
+  }
+
+  int val() const override { return v_; }
+  int v_;
+};
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+
+void* operator new(std::size_t size, std::nothrow_t const& tag) noexcept
+{
+  return counted_allocate(size, tag);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const& tag) noexcept
+{
+  return counted_allocate(size, tag);
+}
+
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_free(ptr); }
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{
+  counted_free(ptr);
+}
+
+TEST_CASE("construction allocation budgets")
+{
+  SECTION("make_val allocates once")
+  {
+    auto b = measure([] { auto vp = make_val<int>(1); });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+
+  SECTION("make_derived_val allocates once")
+  {
+    auto b = measure([] { auto vp = make_derived_val<Base, Derived>(1); });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+
+  SECTION("adopting a pointer allocates the model only")
+  {
+    auto ptr = new int(1);
+    auto b = measure([ptr] { auto vp = value_ptr<int>(ptr); });
+    REQUIRE(b == (budget{ 1, 2 }));
+  }
+
+  SECTION("null value_ptrs do not allocate")
+  {
+    auto b = measure([] {
+      auto vp = value_ptr<int>();
+      auto vp2 = value_ptr<int>(nullptr);
+      auto vp3 = vp;
+    });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+}
+
+TEST_CASE("copy and move allocation budgets")
+{
+  auto vp = make_derived_val<Base, Derived>(1);
+
+  SECTION("copying allocates once")
+  {
+    auto b = measure([&] { auto vp2 = vp; });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+
+  SECTION("copying an adopted pointer allocates once")
+  {
+    auto adopted = value_ptr<Base>(new Derived(2));
+    auto b = measure([&] { auto vp2 = adopted; });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+
+  SECTION("converting copies allocate the copy and an adapter")
+  {
+    auto derived = make_val<Derived>(2);
+    auto b = measure([&] { auto vp2 = value_ptr<Base>(derived); });
+    REQUIRE(b == (budget{ 2, 2 }));
+  }
+
+  SECTION("converting moves allocate an adapter only")
+  {
+    auto derived = make_val<Derived>(2);
+    auto b = measure([&] { auto vp2 = value_ptr<Base>(std::move(derived)); });
+    REQUIRE(b == (budget{ 1, 2 }));
+  }
+
+  SECTION("moving does not allocate")
+  {
+    auto b = measure([&] {
+      auto vp2 = std::move(vp);
+      vp = std::move(vp2);
+    });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("swapping does not allocate")
+  {
+    auto vp2 = make_val<Base>();
+    auto b = measure([&] { swap(vp, vp2); });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("copy assignment between matching types does not allocate")
+  {
+    auto vp2 = make_derived_val<Base, Derived>(2);
+    auto b = measure([&] { vp2 = vp; });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("copy assignment between different types allocates once")
+  {
+    auto vp2 = make_val<Base>();
+    auto b = measure([&] { vp2 = vp; });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+}
+
+TEST_CASE("modifier allocation budgets")
+{
+  auto vp = make_val<int>(1);
+
+  SECTION("emplacing into existing storage does not allocate")
+  {
+    auto b = measure([&] { vp.emplace(2); });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("resetting into existing storage does not allocate")
+  {
+    auto ptr = new int(2);
+    auto b = measure([&] { vp.reset(ptr); });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("resetting to null frees the model")
+  {
+    auto b = measure([&] { vp.reset(); });
+    REQUIRE(b == (budget{ 0, 1 }));
+  }
+
+  SECTION("releasing an adopted pointer does not allocate")
+  {
+    auto adopted = value_ptr<int>(new int(2));
+    int* ptr = nullptr;
+    auto b = measure([&] { ptr = adopted.release(); });
+    REQUIRE(b == (budget{ 0, 1 }));
+    delete ptr;
+  }
+
+  SECTION("releasing an in-place object moves it to a new allocation")
+  {
+    int* ptr = nullptr;
+    auto b = measure([&] { ptr = vp.release(); });
+    REQUIRE(b == (budget{ 1, 1 }));
+    delete ptr;
+  }
+
+  SECTION("to_unique costs the same as release")
+  {
+    auto adopted = value_ptr<int>(new int(2));
+    auto b = measure([&] { auto up = adopted.to_unique(); });
+    REQUIRE(b == (budget{ 0, 2 }));
+  }
+}
+
+TEST_CASE("unique_ptr round trip allocation budgets")
+{
+  auto up = std::unique_ptr<int>(new int(1));
+
+  SECTION("adopting a unique_ptr allocates the model only")
+  {
+    auto b = measure([&] { auto vp = value_ptr<int>(std::move(up)); });
+    REQUIRE(b == (budget{ 1, 2 }));
+  }
+
+  SECTION("a round trip allocates the model only")
+  {
+    auto b = measure([&] {
+      auto vp = value_ptr<int>(std::move(up));
+      up = vp.to_unique();
+    });
+    REQUIRE(b == (budget{ 1, 1 }));
+  }
+}
+
+TEST_CASE("cast allocation budgets")
+{
+  auto vp = make_derived_val<Base, Derived>(1);
+
+  SECTION("casting by pointer does not allocate")
+  {
+    auto b = measure([&] { REQUIRE(value_ptr_cast<Derived>(vp)); });
+    REQUIRE(b == (budget{ 0, 0 }));
+  }
+
+  SECTION("casting ownership allocates an adapter only")
+  {
+    auto b = measure([&] { auto d = value_ptr_cast<Derived>(std::move(vp)); });
+    REQUIRE(b == (budget{ 1, 2 }));
+  }
+
+  SECTION("casting back after converting does not allocate")
+  {
+    auto converted = value_ptr<Base>(make_val<Derived>(1));
+    auto b = measure([&] {
+      auto d = value_ptr_cast<Derived>(std::move(converted));
+      REQUIRE(d);
+    });
+    REQUIRE(b == (budget{ 0, 2 }));
+  }
+}
+
+TEST_CASE("container allocation budgets")
+{
+  auto vec = std::vector<value_ptr<int>>{};
+  vec.reserve(4);
+
+  SECTION("inserting constructed values only allocates the values")
+  {
+    auto b = measure([&] {
+      vec.push_back(make_val<int>(1));
+      vec.emplace_back(make_val<int>(2));
+    });
+    REQUIRE(b == (budget{ 2, 0 }));
+  }
+
+  SECTION("reallocating moves rather than copying")
+  {
+    for (auto i = 0; i < 4; ++i) {
+      vec.push_back(make_val<int>(i));
+    }
+
+    auto b = measure([&] { vec.push_back(make_val<int>(4)); });
+    REQUIRE(b == (budget{ 2, 1 }));
+  }
+}
+
+TEST_CASE("fast_pimpl allocation budgets")
+{
+  struct impl {
+    int value;
+  };
+
+  auto b = measure([] {
+    auto p = fast_pimpl<impl, sizeof(int)>(in_place_type_t<impl>{}, impl{ 1 });
+    auto copy = p;
+    auto moved = std::move(p);
+    copy = moved;
+    REQUIRE(copy->value == 1);
+  });
+  REQUIRE(b == (budget{ 0, 0 }));
+}
+
+struct hooked {
+  int value;
+};
+
+namespace bsc {
+template <>
+struct enable_queue_hook<hooked> : std::true_type {
+};
+} // namespace bsc
+
+TEST_CASE("mpsc_queue allocation budgets")
+{
+  mpsc_queue<hooked> queue;
+  auto msg = make_val<hooked>(hooked{ 1 });
+
+  auto b = measure([&] {
+    queue.push(std::move(msg));
+    msg = queue.pop();
+    queue.push(std::move(msg));
+    msg = queue.pop();
+  });
+  REQUIRE(b == (budget{ 0, 0 }));
+  REQUIRE(msg->value == 1);
+}
+
+TEST_CASE("retire_queue allocation budgets")
+{
+  retire_queue queue;
+  auto ptrs = std::vector<value_ptr<int>>{};
+
+  auto retire_all = [&] {
+    for (auto& ptr : ptrs) {
+      retire(std::move(ptr), queue);
+    }
+  };
+
+  auto refill = [&] {
+    ptrs.clear();
+    for (auto i = 0; i < 8; ++i) {
+      ptrs.push_back(make_val<int>(i));
+    }
+  };
+
+  // The queue alternates between two buffers, which both grow once.
+  for (auto i = 0; i < 2; ++i) {
+    refill();
+    retire_all();
+    queue.reclaim();
+  }
+
+  refill();
+  auto b = measure(retire_all);
+  REQUIRE(b == (budget{ 0, 0 }));
+
+  b = measure([&] { queue.reclaim(); });
+  REQUIRE(b == (budget{ 0, 8 }));
+}
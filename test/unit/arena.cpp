@@ -0,0 +1,144 @@
+#include "catch.hpp"
+
+#include <value_ptr/arena.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct node {
+  node(int v)
+      : value(v)
+  {
+  }
+
+  int value;
+  value_ptr<node> next;
+};
+
+struct alignas(64) wide {
+  wide(int v)
+      : value(v)
+  {
+  }
+
+  int value;
+};
+
+struct throws_on_construction {
+  throws_on_construction() { throw 0; }
+};
+
+bool in_region_of(void const* a, void const* b)
+{
+  auto const mask = ~(detail::arena_region_size - 1);
+  return (reinterpret_cast<std::uintptr_t>(a) & mask)
+      == (reinterpret_cast<std::uintptr_t>(b) & mask);
+}
+
+} // namespace
+
+TEST_CASE("value_ptrs can be allocated from a huge page arena")
+{
+  huge_page_arena arena;
+
+  auto vp = make_arena_val<node>(arena, 3);
+  REQUIRE(vp->value == 3);
+  REQUIRE(arena.regions(huge_page_arena::page_kind::hugetlb)
+          + arena.regions(huge_page_arena::page_kind::transparent)
+          + arena.regions(huge_page_arena::page_kind::normal)
+      == 1);
+
+  SECTION("copies come from the same arena")
+  {
+    auto copy = vp;
+    REQUIRE(copy->value == 3);
+    REQUIRE(copy.get() != vp.get());
+    REQUIRE(in_region_of(copy.get(), vp.get()));
+  }
+
+  SECTION("freed blocks are reused")
+  {
+    auto other = make_arena_val<node>(arena, 4);
+    auto const address = other.get();
+    other.reset();
+
+    auto again = make_arena_val<node>(arena, 5);
+    REQUIRE(again.get() == address);
+  }
+
+  SECTION("released objects are moved to the heap")
+  {
+    auto ptr = vp.to_unique();
+    REQUIRE(ptr->value == 3);
+    REQUIRE(!vp);
+  }
+
+  SECTION("emplacing replaces the arena block")
+  {
+    vp.emplace(6);
+    REQUIRE(vp->value == 6);
+  }
+
+  SECTION("nested value_ptrs keep their own allocation")
+  {
+    vp->next = make_arena_val<node>(arena, 7);
+    auto copy = vp;
+    REQUIRE(copy->next->value == 7);
+  }
+}
+
+TEST_CASE("huge page arenas respect alignment")
+{
+  huge_page_arena arena(false);
+
+  auto objects = std::vector<value_ptr<wide>>{};
+  for (auto i = 0; i < 100; ++i) {
+    objects.push_back(make_arena_val<wide>(arena, i));
+    REQUIRE(reinterpret_cast<std::uintptr_t>(objects.back().get()) % 64 == 0);
+  }
+
+  auto page = arena.allocate(5000, 4096);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(page) % 4096 == 0);
+  huge_page_arena::deallocate(page);
+
+  REQUIRE_THROWS_AS(arena.allocate(16, 8192), std::bad_alloc);
+  REQUIRE_THROWS_AS(arena.allocate(1 << 20, 16), std::bad_alloc);
+}
+
+TEST_CASE("huge page arenas map more regions as they fill")
+{
+  huge_page_arena arena(false);
+
+  auto objects = std::vector<value_ptr<int>>{};
+  for (auto i = 0; i < 200000; ++i) {
+    objects.push_back(make_arena_val<int>(arena, i));
+  }
+
+  REQUIRE(arena.regions(huge_page_arena::page_kind::hugetlb) == 0);
+  REQUIRE(arena.regions(huge_page_arena::page_kind::transparent)
+          + arena.regions(huge_page_arena::page_kind::normal)
+      > 1);
+
+  for (auto i = 0; i < 200000; ++i) {
+    REQUIRE(*objects[i] == i);
+  }
+}
+
+TEST_CASE("huge page arenas free blocks when construction throws")
+{
+  huge_page_arena arena;
+
+  REQUIRE_THROWS(make_arena_val<throws_on_construction>(arena));
+
+  auto first = arena.allocate(16, 16);
+  REQUIRE_THROWS(make_arena_val<throws_on_construction>(arena));
+  auto second = arena.allocate(16, 16);
+  REQUIRE(second != first);
+
+  huge_page_arena::deallocate(first);
+  huge_page_arena::deallocate(second);
+}
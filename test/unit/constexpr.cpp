@@ -0,0 +1,221 @@
+// Built as C++20, in which value_ptrs can be used during constant evaluation.
+// The checks are static_asserts, so this test passes if it compiles.
+
+#include <value_ptr/value_ptr.h>
+
+#include <array>
+#include <cstddef>
+
+#if !VP_HAS_CONSTEXPR20
+#error "this test must be built as C++20 or later"
+#endif
+
+using namespace bsc;
+
+namespace {
+
+// The derived types declare their destructors, which GCC 12 and earlier need
+// in order to call them during constant evaluation.
+struct expr {
+  constexpr virtual ~expr() = default;
+  constexpr virtual int eval(int x) const = 0;
+};
+
+struct var final : expr {
+  constexpr ~var() override {}
+
+  constexpr int eval(int x) const override { return x; }
+};
+
+struct constant final : expr {
+  constexpr explicit constant(int v)
+      : value(v)
+  {
+  }
+
+  constexpr ~constant() override {}
+
+  constexpr int eval(int) const override { return value; }
+
+  int value;
+};
+
+struct add final : expr {
+  constexpr add(value_ptr<expr> l, value_ptr<expr> r)
+      : lhs(std::move(l))
+      , rhs(std::move(r))
+  {
+  }
+
+  constexpr ~add() override {}
+
+  constexpr int eval(int x) const override
+  {
+    return lhs->eval(x) + rhs->eval(x);
+  }
+
+  value_ptr<expr> lhs;
+  value_ptr<expr> rhs;
+};
+
+struct mul final : expr {
+  constexpr mul(value_ptr<expr> l, value_ptr<expr> r)
+      : lhs(std::move(l))
+      , rhs(std::move(r))
+  {
+  }
+
+  constexpr ~mul() override {}
+
+  constexpr int eval(int x) const override
+  {
+    return lhs->eval(x) * rhs->eval(x);
+  }
+
+  value_ptr<expr> lhs;
+  value_ptr<expr> rhs;
+};
+
+// x * x + 3
+constexpr value_ptr<expr> make_rule()
+{
+  return make_derived_val<expr, add>(
+      make_derived_val<expr, mul>(
+          make_derived_val<expr, var>(), make_derived_val<expr, var>()),
+      make_derived_val<expr, constant>(3));
+}
+
+// A lookup table computed from a tree of value_ptrs, of which only the
+// results are embedded in the program.
+constexpr auto table = [] {
+  auto const rule = make_rule();
+  auto values = std::array<int, 8>{};
+  for (auto i = 0; i != 8; ++i) {
+    values[i] = rule->eval(i);
+  }
+  return values;
+}();
+
+static_assert(table[0] == 3);
+static_assert(table[7] == 52);
+
+constexpr bool copies_are_deep()
+{
+  auto a = make_val<int>(1);
+  auto b = a;
+  *b = 2;
+
+  auto c = value_ptr<int>();
+  c = a;
+  *c += 10;
+
+  return *a == 1 && *b == 2 && *c == 11 && a.get() != b.get();
+}
+
+static_assert(copies_are_deep());
+
+constexpr bool copies_keep_dynamic_type()
+{
+  auto a = make_rule();
+  auto b = a;
+  return b.holds<add>() && !b.holds<mul>() && b->eval(2) == 7;
+}
+
+static_assert(copies_keep_dynamic_type());
+
+constexpr bool moves_transfer_ownership()
+{
+  auto a = make_val<int>(1);
+  auto const p = a.get();
+
+  auto b = std::move(a);
+  auto c = value_ptr<int>();
+  c = std::move(b);
+
+  return !a && !b && c.get() == p;
+}
+
+static_assert(moves_transfer_ownership());
+
+constexpr bool reset_and_swap()
+{
+  auto a = make_val<int>(1);
+  auto b = make_val<int>(2);
+  swap(a, b);
+  a.swap(b);
+
+  auto ok = *a == 1 && *b == 2;
+  a.reset();
+  b = nullptr;
+  return ok && !a && !b;
+}
+
+static_assert(reset_and_swap());
+
+constexpr bool reset_adopts_pointers()
+{
+  auto a = value_ptr<expr>(new constant(1));
+  auto ok = a->eval(0) == 1;
+
+  a.reset(new constant(2));
+  ok = ok && a.holds<constant>() && a->eval(0) == 2;
+
+  auto b = a;
+  a.reset(static_cast<constant*>(nullptr));
+  return ok && !a && b->eval(0) == 2;
+}
+
+static_assert(reset_adopts_pointers());
+
+constexpr bool emplace_replaces_objects()
+{
+  auto a = value_ptr<expr>();
+  auto& c = a.emplace<constant>(3);
+  auto ok = a.get() == &c && a->eval(0) == 3;
+
+  a.emplace<var>();
+  return ok && a.holds<var>() && a->eval(5) == 5;
+}
+
+static_assert(emplace_replaces_objects());
+
+struct list_node {
+  int value;
+  value_ptr<list_node> next;
+};
+
+} // namespace
+
+template <>
+struct bsc::enable_iterative_ownership<list_node> : std::true_type {
+};
+
+namespace {
+
+// Iterative ownership uses thread-local worklists at run time, which constant
+// evaluation bypasses.
+constexpr int copy_list(int length)
+{
+  auto head = value_ptr<list_node>();
+  for (auto i = 0; i != length; ++i) {
+    head = make_val<list_node>(i, std::move(head));
+  }
+
+  auto copy = head;
+  auto sum = 0;
+  for (auto node = copy.get(); node; node = node->next.get()) {
+    sum += node->value;
+  }
+  return sum;
+}
+
+static_assert(copy_list(100) == 4950);
+
+} // namespace
+
+int main()
+{
+  // The same code also works at run time.
+  auto const rule = make_rule();
+  return rule->eval(7) == table[7] && copy_list(1000) == 499500 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#define VP_PROFILE_COPIES
+
+#include "catch.hpp"
+
+#include <value_ptr/value_ptr.h>
+
+#include <sstream>
+
+using namespace bsc;
+
+namespace {
+
+struct base {
+  virtual ~base() = default;
+};
+
+struct derived : base {
+  char payload[256];
+};
+
+VP_COPY_SITE void copy_three_times(value_ptr<derived> const& vp)
+{
+  for (auto i = 0; i < 3; ++i) {
+    auto copy = vp;
+  }
+}
+
+VP_COPY_SITE void assign_once(
+    value_ptr<derived>& dest, value_ptr<derived> const& src)
+{
+  dest = src;
+}
+
+VP_COPY_SITE value_ptr<base> convert(value_ptr<derived> const& vp)
+{
+  return value_ptr<base>(vp);
+}
+
+copy_profile::entry const* find_site(
+    std::vector<copy_profile::entry> const& entries, std::size_t copies)
+{
+  for (auto const& e : entries) {
+    if (e.copies == copies) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_CASE("deep copies are attributed to their call sites")
+{
+  auto vp = make_val<derived>();
+  auto other = make_val<derived>();
+  auto moved = value_ptr<derived>();
+  auto empty = value_ptr<derived>();
+
+  copy_profile::reset();
+
+  copy_three_times(vp);
+  assign_once(other, vp);
+  moved = std::move(other);
+  convert(vp);
+  auto empty_copy = empty;
+
+  auto entries = copy_profile::snapshot();
+  REQUIRE(entries.size() == 3);
+
+  auto three = find_site(entries, 3);
+  REQUIRE(three != nullptr);
+  REQUIRE(three->bytes == 3 * vp.deep_size());
+  REQUIRE(entries.front().site == three->site);
+  REQUIRE(!copy_profile::describe(three->site).empty());
+
+  auto out = std::ostringstream{};
+  copy_profile::dump(out);
+  REQUIRE(out.str().find("value_ptr copies: 5") != std::string::npos);
+  REQUIRE(out.str().find("from 3 sites") != std::string::npos);
+
+  copy_profile::reset();
+  REQUIRE(copy_profile::snapshot().empty());
+}
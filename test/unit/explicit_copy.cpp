@@ -0,0 +1,106 @@
+#include "catch.hpp"
+
+#include <value_ptr/explicit_copy.h>
+
+#include <type_traits>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct shape {
+  virtual ~shape() = default;
+  virtual int sides() const = 0;
+};
+
+struct square : shape {
+  int sides() const override { return 4; }
+};
+
+struct circle {
+};
+
+} // namespace
+
+static_assert(!std::is_copy_constructible<explicit_value_ptr<int>>::value,
+    "explicit_value_ptr must not be implicitly copyable");
+static_assert(!std::is_copy_assignable<explicit_value_ptr<int>>::value,
+    "explicit_value_ptr must not be implicitly copyable");
+static_assert(
+    std::is_nothrow_move_constructible<explicit_value_ptr<int>>::value,
+    "explicit_value_ptr must be cheap to move");
+static_assert(
+    !std::is_convertible<value_ptr<int>, explicit_value_ptr<int>>::value,
+    "conversion from value_ptr must be explicit");
+static_assert(
+    !std::is_convertible<explicit_value_ptr<int>, value_ptr<int>>::value,
+    "conversion to value_ptr must be explicit");
+static_assert(
+    !std::is_constructible<explicit_value_ptr<shape>, circle*>::value,
+    "unrelated pointers must not be adopted");
+static_assert(!std::is_constructible<explicit_value_ptr<shape>,
+                  value_ptr<circle>&&>::value,
+    "unrelated value_ptrs must not be converted");
+static_assert(!std::is_constructible<explicit_value_ptr<shape>,
+                  value_ptr<circle> const&>::value,
+    "unrelated value_ptrs must not be converted");
+static_assert(!std::is_constructible<explicit_value_ptr<shape>,
+                  explicit_value_ptr<circle>&&>::value,
+    "unrelated explicit_value_ptrs must not be converted");
+static_assert(std::is_convertible<explicit_value_ptr<square>,
+                  explicit_value_ptr<shape>>::value,
+    "explicit_value_ptrs to derived types must convert implicitly");
+
+TEST_CASE("explicit_value_ptr copies with clone")
+{
+  auto a = make_explicit_val<int>(3);
+  auto b = a.clone();
+  REQUIRE(*b == 3);
+  REQUIRE(a.get() != b.get());
+
+  *b = 4;
+  REQUIRE(*a == 3);
+
+  auto c = std::move(a);
+  REQUIRE(!a);
+  REQUIRE(*c == 3);
+}
+
+TEST_CASE("explicit_value_ptr clones keep the dynamic type")
+{
+  auto a = explicit_value_ptr<shape>(in_place_type_t<square>{});
+  auto b = a.clone();
+  REQUIRE(b->sides() == 4);
+
+  auto shapes = std::vector<explicit_value_ptr<shape>>{};
+  shapes.push_back(std::move(a));
+  shapes.push_back(explicit_value_ptr<shape>(new square()));
+  REQUIRE(shapes[0]->sides() + shapes[1]->sides() == 8);
+}
+
+TEST_CASE("explicit_value_ptr converts explicitly to and from value_ptr")
+{
+  auto vp = make_val<int>(5);
+  auto const address = vp.get();
+
+  SECTION("copying")
+  {
+    auto evp = explicit_value_ptr<int>(vp);
+    REQUIRE(evp.get() != address);
+
+    auto back = static_cast<value_ptr<int>>(evp);
+    REQUIRE(back.get() != evp.get());
+    REQUIRE(*back == 5);
+  }
+
+  SECTION("moving")
+  {
+    auto evp = explicit_value_ptr<int>(std::move(vp));
+    REQUIRE(evp.get() == address);
+
+    auto back = static_cast<value_ptr<int>>(std::move(evp));
+    REQUIRE(back.get() == address);
+    REQUIRE(!evp);
+  }
+}
@@ -0,0 +1,91 @@
+#include "catch.hpp"
+
+#include <value_ptr/fast_pimpl.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+// As it would appear in a header, with impl incomplete and the special member
+// functions defaulted.
+class widget {
+public:
+  widget();
+  explicit widget(std::string name);
+
+  std::string const& name() const;
+  void rename(std::string name);
+
+private:
+  struct impl;
+  fast_pimpl<impl, 64> impl_;
+};
+
+// As it would appear in the source file.
+struct widget::impl {
+  impl() = default;
+  explicit impl(std::string n)
+      : name(std::move(n))
+  {
+  }
+
+  std::string name;
+};
+
+widget::widget()
+    : impl_()
+{
+}
+
+widget::widget(std::string name)
+    : impl_(in_place_type_t<impl>{}, std::move(name))
+{
+}
+
+std::string const& widget::name() const { return impl_->name; }
+
+void widget::rename(std::string name) { impl_->name = std::move(name); }
+
+} // namespace
+
+static_assert(std::is_nothrow_move_constructible<widget>::value,
+    "owners of a fast_pimpl must be cheap to move");
+static_assert(std::is_nothrow_move_assignable<widget>::value,
+    "owners of a fast_pimpl must be cheap to move");
+
+TEST_CASE("fast_pimpl stores the implementation in the object")
+{
+  auto w = widget("a");
+  auto const address = reinterpret_cast<char const*>(&w.name());
+  REQUIRE(address >= reinterpret_cast<char const*>(&w));
+  REQUIRE(address < reinterpret_cast<char const*>(&w) + sizeof(w));
+
+  REQUIRE(widget().name().empty());
+}
+
+TEST_CASE("fast_pimpl has value semantics")
+{
+  auto a = widget("a");
+  auto b = a;
+  b.rename("b");
+  REQUIRE(a.name() == "a");
+  REQUIRE(b.name() == "b");
+
+  a = b;
+  REQUIRE(a.name() == "b");
+
+  auto c = std::move(a);
+  REQUIRE(c.name() == "b");
+
+  a = widget("d");
+  REQUIRE(a.name() == "d");
+
+  auto widgets = std::vector<widget>(100, widget("e"));
+  widgets.emplace_back("f");
+  REQUIRE(widgets.front().name() == "e");
+  REQUIRE(widgets.back().name() == "f");
+}
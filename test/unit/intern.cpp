@@ -0,0 +1,138 @@
+#include "catch.hpp"
+
+#include <value_ptr/intern.h>
+
+#include <functional>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct expr {
+  virtual ~expr() = default;
+  virtual std::size_t hash() const = 0;
+  virtual bool equals(expr const& other) const = 0;
+};
+
+struct expr_hash {
+  std::size_t operator()(expr const& e) const { return e.hash(); }
+};
+
+struct expr_equal {
+  bool operator()(expr const& a, expr const& b) const { return a.equals(b); }
+};
+
+using expr_pool = intern_pool<expr, expr_hash, expr_equal>;
+
+struct num : expr {
+  num(int v)
+      : value(v)
+  {
+  }
+
+  std::size_t hash() const override { return std::hash<int>()(value); }
+
+  bool equals(expr const& other) const override
+  {
+    return value == static_cast<num const&>(other).value;
+  }
+
+  int value;
+};
+
+// Has the same hash and equality as num, but is a different type.
+struct neg : num {
+  using num::num;
+};
+
+struct add : expr {
+  add(frozen_value_ptr<expr> l, frozen_value_ptr<expr> r)
+      : lhs(l)
+      , rhs(r)
+  {
+  }
+
+  std::size_t hash() const override
+  {
+    auto h = std::hash<frozen_value_ptr<expr>>();
+    return h(lhs) * 31 + h(rhs);
+  }
+
+  bool equals(expr const& other) const override
+  {
+    auto const& o = static_cast<add const&>(other);
+    return lhs == o.lhs && rhs == o.rhs;
+  }
+
+  frozen_value_ptr<expr> lhs;
+  frozen_value_ptr<expr> rhs;
+};
+
+} // namespace
+
+TEST_CASE("equal values are interned once")
+{
+  expr_pool pool;
+
+  auto one = pool.intern(make_derived_val<expr, num>(1));
+  auto two = pool.intern(make_derived_val<expr, num>(2));
+  auto another_one = pool.intern(make_derived_val<expr, num>(1));
+
+  REQUIRE(one == another_one);
+  REQUIRE(one != two);
+  REQUIRE(static_cast<num const&>(*one).value == 1);
+  REQUIRE(pool.size() == 2);
+
+  SECTION("dynamic types are part of a value")
+  {
+    auto negative_one = pool.intern(make_derived_val<expr, neg>(1));
+    REQUIRE(negative_one != one);
+    REQUIRE(pool.size() == 3);
+  }
+
+  SECTION("structures built from handles are shared")
+  {
+    auto sum = pool.intern(make_derived_val<expr, add>(one, two));
+    auto same_sum = pool.intern(make_derived_val<expr, add>(another_one, two));
+    auto other_sum = pool.intern(make_derived_val<expr, add>(two, one));
+
+    REQUIRE(sum == same_sum);
+    REQUIRE(sum != other_sum);
+    REQUIRE(pool.size() == 4);
+  }
+
+  SECTION("interning an lvalue copies only new values")
+  {
+    auto three = make_derived_val<expr, num>(3);
+    auto frozen = pool.intern(three);
+    REQUIRE(three);
+    REQUIRE(frozen.get() != three.get());
+    REQUIRE(pool.intern(three) == frozen);
+
+    auto existing = make_derived_val<expr, num>(1);
+    REQUIRE(pool.intern(existing) == one);
+    REQUIRE(pool.size() == 3);
+  }
+
+  SECTION("null values give null handles")
+  {
+    REQUIRE(!pool.intern(value_ptr<expr>()));
+    REQUIRE(pool.size() == 2);
+  }
+}
+
+TEST_CASE("handles are the size of a pointer")
+{
+  REQUIRE(sizeof(frozen_value_ptr<expr>) == sizeof(expr*));
+
+  intern_pool<int> pool;
+  auto handles = std::vector<frozen_value_ptr<int>>{};
+  for (auto i = 0; i < 1000; ++i) {
+    handles.push_back(pool.intern(make_val<int>(i % 10)));
+  }
+
+  REQUIRE(pool.size() == 10);
+  REQUIRE(handles[3] == handles[13]);
+  REQUIRE(*handles[3] == 3);
+}
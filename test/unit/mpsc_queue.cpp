@@ -0,0 +1,134 @@
+#include "catch.hpp"
+
+#include <value_ptr/mpsc_queue.h>
+
+#include <thread>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct message {
+  message(int p, int s)
+      : producer(p)
+      , sequence(s)
+  {
+  }
+
+  virtual ~message() = default;
+
+  int producer;
+  int sequence;
+};
+
+struct counted_message : message {
+  counted_message(int& c)
+      : message(0, 0)
+      , count(c)
+  {
+    ++count;
+  }
+
+  counted_message(counted_message const& other)
+      : counted_message(other.count)
+  {
+  }
+
+  ~counted_message() { --count; }
+
+  int& count;
+};
+
+} // namespace
+
+namespace bsc {
+template <>
+struct enable_queue_hook<message> : std::true_type {
+};
+} // namespace bsc
+
+TEST_CASE("mpsc_queue pops messages in the order they were pushed")
+{
+  mpsc_queue<message> queue;
+  REQUIRE(queue.empty());
+  REQUIRE(!queue.pop());
+
+  auto first = make_val<message>(0, 1);
+  auto const address = first.get();
+  queue.push(std::move(first));
+  REQUIRE(!first);
+  REQUIRE(!queue.empty());
+
+  queue.push(make_val<message>(0, 2));
+  queue.push(value_ptr<message>());
+  queue.push(make_val<message>(0, 3));
+
+  auto popped = queue.pop();
+  REQUIRE(popped.get() == address);
+  REQUIRE(popped->sequence == 1);
+  REQUIRE(queue.pop()->sequence == 2);
+  REQUIRE(queue.pop()->sequence == 3);
+  REQUIRE(!queue.pop());
+  REQUIRE(queue.empty());
+
+  queue.push(make_val<message>(0, 4));
+  REQUIRE(queue.pop()->sequence == 4);
+  REQUIRE(!queue.pop());
+}
+
+TEST_CASE("mpsc_queue keeps dynamic types and frees what is left")
+{
+  auto count = 0;
+
+  {
+    mpsc_queue<message> queue;
+    queue.push(make_derived_val<message, counted_message>(count));
+    queue.push(make_derived_val<message, counted_message>(count));
+    queue.push(make_derived_val<message, counted_message>(count));
+    REQUIRE(count == 3);
+
+    auto popped = queue.pop();
+    auto copy = popped;
+    REQUIRE(count == 4);
+  }
+
+  REQUIRE(count == 0);
+}
+
+TEST_CASE("mpsc_queue accepts messages from several producers")
+{
+  constexpr auto producers = 4;
+  constexpr auto messages = 20000;
+
+  mpsc_queue<message> queue;
+  auto threads = std::vector<std::thread>{};
+
+  for (auto p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (auto i = 0; i < messages; ++i) {
+        queue.push(make_val<message>(p, i));
+      }
+    });
+  }
+
+  auto next = std::vector<int>(producers, 0);
+  auto received = 0;
+  while (received < producers * messages) {
+    auto msg = queue.pop();
+    if (!msg) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    REQUIRE(msg->sequence == next[msg->producer]);
+    ++next[msg->producer];
+    ++received;
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  REQUIRE(!queue.pop());
+}
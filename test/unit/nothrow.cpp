@@ -0,0 +1,262 @@
+// Built with -fno-exceptions and -fno-rtti, so this test can't use Catch; it
+// reports failed checks itself and exits with a non-zero status.
+
+#include <value_ptr/arena.h>
+#include <value_ptr/explicit_copy.h>
+#include <value_ptr/fast_pimpl.h>
+#include <value_ptr/intern.h>
+#include <value_ptr/mpsc_queue.h>
+#include <value_ptr/parallel.h>
+#include <value_ptr/pooled.h>
+#include <value_ptr/retire.h>
+#include <value_ptr/tagged.h>
+#include <value_ptr/value_ptr.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#if VP_HAS_EXCEPTIONS
+#error "this test must be built without exceptions"
+#endif
+
+using namespace bsc;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+          #cond);                                                             \
+      ++failures;                                                             \
+    }                                                                         \
+  } while (false)
+
+// Every allocation goes through these, so that allocations can be made to
+// fail and leaks detected.
+std::size_t live_allocations = 0;
+std::size_t allocations_until_failure = ~std::size_t(0);
+
+void* checked_allocate(std::size_t size) noexcept
+{
+  if (allocations_until_failure == 0) {
+    return nullptr;
+  }
+
+  --allocations_until_failure;
+  ++live_allocations;
+  return std::malloc(size ? size : 1);
+}
+
+void checked_free(void* ptr) noexcept
+{
+  if (ptr) {
+    --live_allocations;
+    std::free(ptr);
+  }
+}
+
+/**
+ * Make the allocation after the next count allocations fail, until reset.
+ */
+struct fail_after {
+  explicit fail_after(std::size_t count) { allocations_until_failure = count; }
+  ~fail_after() { allocations_until_failure = ~std::size_t(0); }
+};
+
+struct base {
+  virtual ~base() = default;
+  virtual int value() const { return 0; }
+};
+
+struct derived : base {
+  explicit derived(int v)
+      : v_(v)
+  {
+  }
+
+  int value() const override { return v_; }
+
+  int v_;
+};
+
+// Allocates models from the heap, up to a fixed number of them.
+struct limited_arena {
+  void* allocate(std::size_t size, std::size_t align)
+  {
+    auto block = try_allocate(size, align);
+    if (!block) {
+      std::abort();
+    }
+    return block;
+  }
+
+  void* try_allocate(std::size_t size, std::size_t) noexcept
+  {
+    if (blocks == 0) {
+      return nullptr;
+    }
+
+    --blocks;
+    return ::operator new(size, std::nothrow);
+  }
+
+  static void deallocate(void* ptr) noexcept { ::operator delete(ptr); }
+
+  std::size_t blocks;
+};
+
+struct shape {
+  std::size_t sides;
+};
+
+struct square : shape {
+  square() { sides = 4; }
+};
+
+void test_try_make_val()
+{
+  auto a = try_make_val<int>(1);
+  CHECK(a && *a == 1);
+
+  {
+    fail_after guard(0);
+    auto b = try_make_val<std::string>("b");
+    CHECK(!b);
+
+    auto c = value_ptr<base>(std::nothrow, in_place_type_t<derived>{}, 3);
+    CHECK(!c);
+  }
+
+  auto d = value_ptr<base>(std::nothrow, in_place_type_t<derived>{}, 4);
+  CHECK(d && d->value() == 4);
+}
+
+void test_try_clone()
+{
+  auto a = make_derived_val<base, derived>(1);
+
+  auto b = a.try_clone();
+  CHECK(b && b.get() != a.get());
+  CHECK(b.holds<derived>() && b->value() == 1);
+
+  {
+    fail_after guard(0);
+    CHECK(!a.try_clone());
+  }
+
+  CHECK(!value_ptr<base>().try_clone());
+
+  // Adopted objects are copied into a model of their own.
+  auto c = value_ptr<base>(new derived(2));
+  {
+    fail_after guard(0);
+    CHECK(!c.try_clone());
+  }
+  CHECK(c.try_clone()->value() == 2);
+
+  // Converted value_ptrs need an adapter as well as the inner copy; either
+  // allocation may fail.
+  auto d = value_ptr<base>(make_val<derived>(3));
+  for (auto i = 0; i != 2; ++i) {
+    fail_after guard(i);
+    CHECK(!d.try_clone());
+  }
+  CHECK(d.try_clone()->value() == 3);
+}
+
+void test_arena_try_clone()
+{
+  limited_arena arena{ 2 };
+
+  auto a = make_arena_val<derived>(arena, 1);
+  auto b = a.try_clone();
+  CHECK(b && b->value() == 1);
+  CHECK(!a.try_clone());
+}
+
+void test_other_headers()
+{
+  using any_shape = tagged_value_ptr<shape, shape, square>;
+
+  auto s = any_shape(in_place_type_t<square>{});
+  auto t = s;
+  CHECK(t.get_if<square>() && t->sides == 4);
+
+  auto p = make_pooled_val<int>(5);
+  auto q = p;
+  CHECK(*q == 5 && q.handle() != p.handle());
+
+  huge_page_arena arena;
+  auto r = make_arena_val<int>(arena, 6);
+  CHECK(*r.try_clone() == 6);
+
+  auto in = std::vector<value_ptr<int>>(10, make_val<int>(7));
+  auto out = std::vector<value_ptr<int>>(in.size());
+  parallel_deep_copy(in.begin(), in.end(), out.begin(), 2);
+  CHECK(*out.back() == 7);
+}
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+  if (auto ptr = checked_allocate(size)) {
+    return ptr;
+  }
+
+  // There is no exception to throw.
+  std::abort();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+  return checked_allocate(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+  return checked_allocate(size);
+}
+
+void operator delete(void* ptr) noexcept { checked_free(ptr); }
+void operator delete[](void* ptr) noexcept { checked_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { checked_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { checked_free(ptr); }
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{
+  checked_free(ptr);
+}
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{
+  checked_free(ptr);
+}
+
+int main()
+{
+  auto const live = live_allocations;
+
+  test_try_make_val();
+  test_try_clone();
+  test_arena_try_clone();
+
+  CHECK(live_allocations == live);
+
+  test_other_headers();
+
+  if (failures) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
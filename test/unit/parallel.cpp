@@ -0,0 +1,152 @@
+#include "catch.hpp"
+
+#include <value_ptr/parallel.h>
+
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+std::atomic<int> live{ 0 };
+
+struct counted {
+  virtual ~counted() { --live; }
+  virtual int value() const { return v_; }
+
+  counted(int v)
+      : v_(v)
+  {
+    ++live;
+  }
+
+  counted(counted const& o)
+      : v_(o.v_)
+  {
+    ++live;
+  }
+
+  counted& operator=(counted const&) = default;
+
+  int v_;
+};
+
+struct counted_derived : counted {
+  using counted::counted;
+  int value() const override { return -v_; }
+};
+
+// Starts real threads until it has started limit of them, then fails as
+// std::thread does when the system is out of threads.
+struct limited_launcher {
+  template <typename F>
+  std::thread operator()(F& f, unsigned i)
+  {
+    if (*started == limit) {
+      throw std::system_error(
+          std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+
+    ++*started;
+    return std::thread(f, i);
+  }
+
+  unsigned* started;
+  unsigned limit;
+};
+
+} // namespace
+
+TEST_CASE("ranges can be deep-copied in parallel")
+{
+  auto const size = 50000;
+
+  {
+    auto src = std::vector<value_ptr<counted>>{};
+    for (auto i = 0; i < size; ++i) {
+      if (i % 3 == 0) {
+        src.emplace_back(new counted_derived(i));
+      } else {
+        src.emplace_back(new counted(i));
+      }
+    }
+    src.emplace_back(nullptr);
+
+    auto dst = std::vector<value_ptr<counted>>(src.size());
+
+    SECTION("with an explicit thread count")
+    {
+      auto end = parallel_deep_copy(src.begin(), src.end(), dst.begin(), 4);
+      REQUIRE(end == dst.end());
+    }
+
+    SECTION("with the default thread count")
+    {
+      parallel_deep_copy(src.begin(), src.end(), dst.begin());
+    }
+
+    REQUIRE(live == 2 * size);
+    REQUIRE(!dst.back());
+
+    for (auto i = 0; i < size; ++i) {
+      REQUIRE(dst[i].get() != src[i].get());
+      REQUIRE(dst[i]->value() == src[i]->value());
+    }
+  }
+
+  REQUIRE(live == 0);
+}
+
+TEST_CASE("small ranges are copied without spawning threads")
+{
+  auto src = std::vector<value_ptr<int>>{};
+  src.emplace_back(new int(1));
+  src.emplace_back(new int(2));
+
+  auto dst = std::vector<value_ptr<int>>(2);
+  parallel_deep_copy(src.begin(), src.end(), dst.begin(), 64);
+
+  REQUIRE(*dst[0] == 1);
+  REQUIRE(*dst[1] == 2);
+}
+
+TEST_CASE("chunks are copied on the calling thread if workers can't start")
+{
+  auto const size = 50000;
+
+  {
+    auto src = std::vector<value_ptr<counted>>{};
+    for (auto i = 0; i < size; ++i) {
+      src.emplace_back(new counted(i));
+    }
+
+    auto dst = std::vector<value_ptr<counted>>(src.size());
+    auto started = 0u;
+
+    SECTION("after some have started")
+    {
+      detail::parallel_deep_copy(src.begin(), src.end(), dst.begin(), 8,
+          limited_launcher{ &started, 2 });
+      REQUIRE(started == 2);
+    }
+
+    SECTION("when none can start")
+    {
+      detail::parallel_deep_copy(src.begin(), src.end(), dst.begin(), 8,
+          limited_launcher{ &started, 0 });
+      REQUIRE(started == 0);
+    }
+
+    REQUIRE(live == 2 * size);
+
+    for (auto i = 0; i < size; ++i) {
+      REQUIRE(dst[i].get() != src[i].get());
+      REQUIRE(dst[i]->value() == src[i]->value());
+    }
+  }
+
+  REQUIRE(live == 0);
+}
@@ -0,0 +1,132 @@
+#include "catch.hpp"
+
+#include <value_ptr/pooled.h>
+
+#include <string>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+struct point {
+  point(int x_, int y_)
+      : x(x_)
+      , y(y_)
+  {
+  }
+
+  int x;
+  int y;
+};
+
+// Each test case uses its own pool, so they don't see each other's objects.
+struct semantics_pool;
+struct iteration_pool;
+struct generation_pool;
+
+} // namespace
+
+static_assert(sizeof(pooled_value_ptr<point>) == 4,
+    "pooled_value_ptr should be a 32-bit handle");
+
+TEST_CASE("pooled_value_ptr has value semantics")
+{
+  using ptr = pooled_value_ptr<std::string, semantics_pool>;
+  auto& pool = ptr::pool_type::instance();
+
+  auto a = ptr(in_place_type_t<std::string>{}, "a");
+  REQUIRE(*a == "a");
+  REQUIRE(pool.size() == 1);
+
+  auto b = a;
+  REQUIRE(b.handle() != a.handle());
+  REQUIRE(*b == "a");
+  REQUIRE(pool.size() == 2);
+
+  *b = "b";
+  REQUIRE(*a == "a");
+
+  auto c = std::move(b);
+  REQUIRE_FALSE(b);
+  REQUIRE(*c == "b");
+  REQUIRE(pool.size() == 2);
+
+  a = c;
+  REQUIRE(*a == "b");
+  REQUIRE(pool.size() == 2);
+
+  c.reset();
+  REQUIRE_FALSE(c);
+  REQUIRE(c.get() == nullptr);
+  REQUIRE(pool.size() == 1);
+
+  a = nullptr;
+  REQUIRE(pool.size() == 0);
+
+  auto p = make_pooled_val<point>(1, 2);
+  REQUIRE(p->x == 1);
+  REQUIRE(p->y == 2);
+}
+
+TEST_CASE("value_pool stores objects densely")
+{
+  using ptr = pooled_value_ptr<point, iteration_pool>;
+  auto& pool = ptr::pool_type::instance();
+
+  auto points = std::vector<ptr>();
+  for (auto i = 0; i != 1000; ++i) {
+    points.emplace_back(in_place_type_t<point>{}, i, -i);
+  }
+
+  // Erase every other object; the rest are moved to fill the holes.
+  for (auto i = 0; i < 1000; i += 2) {
+    points[i].reset();
+  }
+
+  REQUIRE(pool.size() == 500);
+  REQUIRE(pool.end() - pool.begin() == 500);
+
+  auto sum = 0;
+  for (auto const& p : pool) {
+    sum += p.x;
+    REQUIRE(p.y == -p.x);
+  }
+  REQUIRE(sum == 250000);
+
+  for (auto i = 1; i < 1000; i += 2) {
+    REQUIRE(points[i]->x == i);
+  }
+
+  points.clear();
+  REQUIRE(pool.size() == 0);
+}
+
+TEST_CASE("value_pool doesn't resolve handles to erased objects")
+{
+  auto& pool = value_pool<int, generation_pool, 2>::instance();
+
+  auto const a = pool.emplace(1);
+  pool.erase(a);
+  REQUIRE_FALSE(pool.contains(a));
+  REQUIRE(pool.get(a) == nullptr);
+  REQUIRE_FALSE(pool.contains(0));
+
+  // The slot is reused with the next generation.
+  auto const b = pool.emplace(2);
+  REQUIRE(b != a);
+  REQUIRE(pool.get(a) == nullptr);
+  REQUIRE(*pool.get(b) == 2);
+
+  // Erasing twice is harmless.
+  pool.erase(b);
+  pool.erase(b);
+  REQUIRE(pool.size() == 0);
+
+  // With two generation bits, handles repeat after four uses of a slot.
+  pool.erase(pool.emplace(3));
+  pool.erase(pool.emplace(4));
+  auto const c = pool.emplace(5);
+  REQUIRE(c == a);
+  pool.erase(c);
+}
@@ -0,0 +1,67 @@
+#define VP_PROFILE_TYPES
+
+#include "catch.hpp"
+
+#include <value_ptr/value_ptr.h>
+
+#include <sstream>
+
+using namespace bsc;
+
+namespace {
+
+struct shape {
+  virtual ~shape() = default;
+  virtual int sides() const = 0;
+};
+
+struct triangle final : shape {
+  int sides() const override { return 3; }
+};
+
+struct square final : shape {
+  int sides() const override { return 4; }
+};
+
+} // namespace
+
+TEST_CASE("dereferences record dynamic types")
+{
+  type_profile<shape>::reset();
+
+  auto shapes = std::vector<value_ptr<shape>>{};
+  for (auto i = 0; i < 10; ++i) {
+    if (i % 5 == 0) {
+      shapes.push_back(make_derived_val<shape, square>());
+    } else {
+      shapes.push_back(make_derived_val<shape, triangle>());
+    }
+  }
+
+  auto total = 0;
+  for (auto const& s : shapes) {
+    total += s->sides();
+  }
+  REQUIRE(total == 32);
+
+  total = 0;
+  for (auto const& s : shapes) {
+    total += s.with_likely<triangle>(
+        [](shape const& sh) { return sh.sides(); });
+  }
+  REQUIRE(total == 32);
+
+  auto profile = type_profile<shape>::snapshot();
+  REQUIRE(profile.size() == 2);
+  REQUIRE(profile[0].type.find("triangle") != std::string::npos);
+  REQUIRE(profile[0].count == 16);
+  REQUIRE(profile[1].type.find("square") != std::string::npos);
+  REQUIRE(profile[1].count == 4);
+
+  auto out = std::ostringstream{};
+  type_profile<shape>::dump(out);
+  REQUIRE(out.str().find("20 dereferences") != std::string::npos);
+
+  type_profile<shape>::reset();
+  REQUIRE(type_profile<shape>::snapshot().empty());
+}
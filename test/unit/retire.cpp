@@ -0,0 +1,146 @@
+#include "catch.hpp"
+
+#include <value_ptr/retire.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace bsc;
+
+namespace {
+
+struct document {
+  document(std::atomic<int>& c)
+      : c_(c)
+  {
+    ++c_;
+  }
+
+  document(document const& o)
+      : document(o.c_)
+  {
+  }
+
+  ~document() { --c_; }
+
+  std::atomic<int>& c_;
+};
+
+struct chain_node {
+  chain_node(std::atomic<int>& c)
+      : doc(c)
+  {
+  }
+
+  document doc;
+  value_ptr<chain_node> next;
+};
+
+} // namespace
+
+namespace bsc {
+template <>
+struct enable_iterative_ownership<chain_node> : std::true_type {
+};
+} // namespace bsc
+
+namespace {
+
+value_ptr<chain_node> make_chain(std::atomic<int>& count, int length)
+{
+  auto head = value_ptr<chain_node>(nullptr);
+  for (auto i = 0; i < length; ++i) {
+    auto node = make_val<chain_node>(count);
+    node->next = std::move(head);
+    head = std::move(node);
+  }
+  return head;
+}
+
+} // namespace
+
+TEST_CASE("retired payloads are destroyed on reclaim")
+{
+  std::atomic<int> count{ 0 };
+  retire_queue queue;
+
+  auto v1 = make_val<document>(count);
+  auto v2 = make_val<document>(count);
+  auto empty = value_ptr<document>();
+  REQUIRE(count == 2);
+
+  retire(std::move(v1), queue);
+  retire(std::move(v2), queue);
+  retire(std::move(empty), queue);
+  REQUIRE(!v1);
+  REQUIRE(!v2);
+  REQUIRE(queue.size() == 2);
+  REQUIRE(count == 2);
+
+  REQUIRE(queue.reclaim() == 2);
+  REQUIRE(queue.size() == 0);
+  REQUIRE(count == 0);
+}
+
+TEST_CASE("retire queues reclaim when destroyed")
+{
+  std::atomic<int> count{ 0 };
+
+  {
+    retire_queue queue;
+    queue.retire(make_val<document>(count));
+    REQUIRE(count == 1);
+  }
+
+  REQUIRE(count == 0);
+}
+
+TEST_CASE("background reapers reclaim retired payloads")
+{
+  std::atomic<int> count{ 0 };
+  retire_queue queue;
+
+  SECTION("when woken")
+  {
+    background_reaper reaper(queue, std::chrono::hours(1));
+
+    retire(make_val<document>(count), queue);
+    reaper.wake();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (count != 0 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+
+    REQUIRE(count == 0);
+  }
+
+  SECTION("when stopped")
+  {
+    {
+      background_reaper reaper(queue, std::chrono::hours(1));
+      retire(make_val<document>(count), queue);
+      retire(make_val<document>(count), queue);
+    }
+
+    REQUIRE(count == 0);
+  }
+}
+
+TEST_CASE("thread retire queues reclaim iterative payloads at thread exit")
+{
+  std::atomic<int> count{ 0 };
+  auto retired = 0;
+
+  std::thread([&] {
+    // Destroying a chain first creates the thread's teardown worklist before
+    // its retire queue, so the worklist is destroyed first at thread exit.
+    make_chain(count, 10);
+
+    retire(make_chain(count, 1000), thread_retire_queue());
+    retired = count;
+  }).join();
+
+  REQUIRE(retired == 1000);
+  REQUIRE(count == 0);
+}
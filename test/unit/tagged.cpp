@@ -0,0 +1,98 @@
+#include "catch.hpp"
+
+#include <value_ptr/tagged.h>
+
+#include <string>
+#include <vector>
+
+using namespace bsc;
+
+namespace {
+
+// A closed hierarchy with no virtual functions, including the destructor.
+struct shape {
+  explicit shape(std::size_t s)
+      : sides(s)
+  {
+  }
+
+  std::size_t sides;
+};
+
+struct triangle : shape {
+  triangle()
+      : shape(3)
+  {
+  }
+};
+
+struct polygon : shape {
+  polygon(std::size_t s, std::string n)
+      : shape(s)
+      , name(std::move(n))
+  {
+  }
+
+  std::string name;
+};
+
+using any_shape = tagged_value_ptr<shape, shape, triangle, polygon>;
+
+} // namespace
+
+static_assert(sizeof(any_shape) == sizeof(void*),
+    "tagged_value_ptr should be one pointer");
+
+TEST_CASE("tagged_value_ptr keeps the dynamic type in the pointer")
+{
+  auto a = any_shape(in_place_type_t<polygon>{}, 5, "pentagon");
+  REQUIRE(a->sides == 5);
+  REQUIRE(a.index() == 2);
+  REQUIRE(a.get_if<polygon>()->name == "pentagon");
+  REQUIRE(a.get_if<triangle>() == nullptr);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(a.get()) % alignof(shape) == 0);
+
+  auto b = any_shape(in_place_type_t<triangle>{});
+  REQUIRE(b->sides == 3);
+  REQUIRE(b.get_if<triangle>() != nullptr);
+
+  auto c = any_shape();
+  REQUIRE_FALSE(c);
+  REQUIRE(c == nullptr);
+  REQUIRE(c.get_if<shape>() == nullptr);
+
+  c.emplace<shape>(4);
+  REQUIRE(c.index() == 0);
+  REQUIRE(c->sides == 4);
+}
+
+TEST_CASE("tagged_value_ptr copies and destroys with the dynamic type")
+{
+  auto a = any_shape(in_place_type_t<polygon>{}, 6, "hexagon");
+
+  auto b = a;
+  REQUIRE(b != a);
+  REQUIRE(b.index() == 2);
+  REQUIRE(b.get_if<polygon>()->name == "hexagon");
+
+  b.get_if<polygon>()->name = "other";
+  REQUIRE(a.get_if<polygon>()->name == "hexagon");
+
+  auto c = std::move(a);
+  REQUIRE_FALSE(a);
+  REQUIRE(c.get_if<polygon>()->name == "hexagon");
+
+  a = c;
+  REQUIRE(a.get_if<polygon>()->name == "hexagon");
+
+  a = any_shape(in_place_type_t<triangle>{});
+  REQUIRE(a.get_if<triangle>() != nullptr);
+
+  auto shapes = std::vector<any_shape>(10, c);
+  shapes.emplace_back(in_place_type_t<triangle>{});
+  REQUIRE(shapes.front().get_if<polygon>()->name == "hexagon");
+  REQUIRE(shapes.back()->sides == 3);
+
+  c.reset();
+  REQUIRE_FALSE(c);
+}
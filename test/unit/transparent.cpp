@@ -0,0 +1,175 @@
+#include "catch.hpp"
+
+#include <value_ptr/value_ptr.h>
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <set>
+#include <unordered_set>
+
+using namespace bsc;
+
+// Built as C++11, C++14 and C++20, so that the heterogeneous lookups each
+// standard adds are tested. Every allocation made by these executables is
+// counted, so that those lookups can be checked not to allocate.
+namespace {
+
+std::size_t allocations = 0;
+
+void* counted_allocate(std::size_t size, std::nothrow_t const&) noexcept
+{
+  ++allocations;
+  return std::malloc(size ? size : 1);
+}
+
+void* counted_allocate(std::size_t size)
+{
+  if (auto ptr = counted_allocate(size, std::nothrow)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc();
+}
+
+template <typename Func>
+std::size_t count_allocations(Func&& f)
+{
+  auto allocs = allocations;
+  f();
+  return allocations - allocs;
+}
+
+struct Base {
+  virtual ~Base() = default;
+  virtual int val() { return 0; }
+};
+
+struct Derived : Base {
+  Derived(int v)
+      : v_(v)
+  {
+  }
+
+  int val() override { return v_; }
+  int v_;
+};
+
+struct padding {
+  virtual ~padding() = default;
+  long pad = 0;
+};
+
+// Base is not at offset zero, so pointers to it have to be adjusted.
+struct offset_derived : padding, Base {
+  int val() override { return 9; }
+};
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+
+void* operator new(std::size_t size, std::nothrow_t const& tag) noexcept
+{
+  return counted_allocate(size, tag);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const& tag) noexcept
+{
+  return counted_allocate(size, tag);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{
+  std::free(ptr);
+}
+
+TEST_CASE("transparent comparators look up keys by address")
+{
+  auto vp = make_derived_val<Base, offset_derived>();
+  auto raw = value_ptr_cast<offset_derived>(vp);
+  REQUIRE(static_cast<void*>(raw) != static_cast<void*>(vp.get()));
+
+  auto other = std::unique_ptr<Base>(new Derived(1));
+
+  SECTION("called directly")
+  {
+    auto less = value_ptr_less<Base>();
+    REQUIRE(!less(vp, raw));
+    REQUIRE(!less(raw, vp));
+    REQUIRE(less(vp, other) != less(other, vp));
+    REQUIRE(less(nullptr, vp));
+
+    auto equal = value_ptr_equal<Base>();
+    REQUIRE(equal(vp, raw));
+    REQUIRE(equal(raw, vp.get()));
+    REQUIRE(!equal(vp, other));
+    REQUIRE(equal(value_ptr<Base>(), nullptr));
+
+    auto hash = value_ptr_hash<Base>();
+    REQUIRE(hash(vp) == hash(raw));
+    REQUIRE(hash(vp) == std::hash<value_ptr<Base>>()(vp));
+
+    auto allocs = count_allocations([&] {
+      less(vp, raw);
+      equal(vp, other);
+      hash(raw);
+    });
+    REQUIRE(allocs == 0);
+  }
+
+  SECTION("in containers")
+  {
+    auto const address = vp.get();
+
+    auto set = std::set<value_ptr<Base>, value_ptr_less<Base>>{};
+    set.insert(std::move(vp));
+    REQUIRE(set.size() == 1);
+
+    // Keys are compared by address, and a copy has a new one, so insert by
+    // moving (containers may hash the argument of insert rather than the copy
+    // they make of it).
+    auto unordered = std::unordered_set<value_ptr<Base>, value_ptr_hash<Base>,
+        value_ptr_equal<Base>>{};
+    unordered.insert(value_ptr<Base>(*set.begin()));
+    REQUIRE(unordered.size() == 1);
+
+#if __cplusplus >= 201402L
+    auto found = false;
+    auto counted = std::size_t{ 1 };
+    auto allocs = count_allocations([&] {
+      found = set.find(raw) != set.end() && set.find(address) != set.end();
+      counted = set.count(other);
+    });
+    REQUIRE(found);
+    REQUIRE(counted == 0);
+    REQUIRE(allocs == 0);
+#else
+    (void)address;
+#endif
+
+#if defined(__cpp_lib_generic_unordered_lookup)
+    auto copy_address = unordered.begin()->get();
+    auto found_copy = false;
+    auto found_raw = true;
+    auto unordered_allocs = count_allocations([&] {
+      found_copy = unordered.find(copy_address) != unordered.end();
+      found_raw = unordered.find(raw) != unordered.end();
+    });
+    REQUIRE(found_copy);
+    REQUIRE(!found_raw);
+    REQUIRE(unordered_allocs == 0);
+#endif
+  }
+}
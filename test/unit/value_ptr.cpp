@@ -2,8 +2,10 @@
 
 #include <value_ptr/value_ptr.h>
 
+#include <cstdint>
 #include <map>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -381,6 +383,8 @@ struct Derived : Base {
   {
   }
 
+  Derived& operator=(Derived const&) = default;
+
   int val() override { return v_; }
   int v_;
 };
@@ -404,6 +408,142 @@ TEST_CASE("make_derived_val can be used")
   }
 }
 
+struct MoreDerived : Derived {
+  MoreDerived(int v)
+      : Derived(v)
+  {
+  }
+
+  int val() override { return -v_; }
+};
+
+TEST_CASE("converting between value_ptr types keeps the dynamic type")
+{
+  auto vp = value_ptr<Derived>(in_place_type_t<MoreDerived>{}, 5);
+
+  auto vp2 = value_ptr<Base>(vp);
+  REQUIRE(vp2->val() == -6);
+
+  auto vp3 = vp2;
+  REQUIRE(vp3->val() == -7);
+
+  auto vp4 = value_ptr<Base>(std::move(vp));
+  REQUIRE(!vp);
+  REQUIRE(vp4->val() == -5);
+
+  // Releasing copies the object out of the model, as Derived is not movable.
+  auto ptr = vp4.release();
+  REQUIRE(ptr->val() == -6);
+  delete ptr;
+
+  auto empty = value_ptr<Base>(value_ptr<Derived>());
+  REQUIRE(!empty);
+}
+
+struct VirtualBase {
+  virtual ~VirtualBase() = default;
+  virtual int val() const { return 0; }
+};
+
+struct VirtualDerived : virtual VirtualBase {
+  int val() const override { return 1; }
+};
+
+TEST_CASE("exact dynamic types can be checked")
+{
+  auto vp = make_derived_val<Base, Derived>(1);
+  REQUIRE(vp.holds<Derived>());
+  REQUIRE(!vp.holds<Base>());
+  REQUIRE(!vp.holds<MoreDerived>());
+
+  auto vp2 = value_ptr<Base>(in_place_type_t<MoreDerived>{}, 1);
+  REQUIRE(vp2.holds<MoreDerived>());
+  REQUIRE(!vp2.holds<Derived>());
+
+  auto converted = value_ptr<Base>(make_val<Derived>(1));
+  REQUIRE(converted.holds<Derived>());
+
+  REQUIRE(!value_ptr<Base>().holds<Base>());
+}
+
+TEST_CASE("value_ptr_cast gets objects as their dynamic type")
+{
+  SECTION("by pointer")
+  {
+    auto vp = make_derived_val<Base, Derived>(4);
+
+    Derived* d = value_ptr_cast<Derived>(vp);
+    REQUIRE(d == vp.get());
+    REQUIRE(d->v_ == 4);
+
+    REQUIRE(value_ptr_cast<Base>(vp) == nullptr);
+    REQUIRE(value_ptr_cast<MoreDerived>(vp) == nullptr);
+    REQUIRE(value_ptr_cast<Derived>(value_ptr<Base>()) == nullptr);
+  }
+
+  SECTION("by moving ownership")
+  {
+    auto vp = make_derived_val<Base, Derived>(4);
+    auto ptr = vp.get();
+
+    auto wrong = value_ptr_cast<MoreDerived>(std::move(vp));
+    REQUIRE(!wrong);
+    REQUIRE(vp.get() == ptr);
+
+    value_ptr<Derived> d = value_ptr_cast<Derived>(std::move(vp));
+    REQUIRE(!vp);
+    REQUIRE(d.get() == ptr);
+    REQUIRE(d->v_ == 4);
+
+    auto copy = d;
+    REQUIRE(copy->v_ == 5);
+  }
+
+  SECTION("after converting")
+  {
+    auto vp = value_ptr<Base>(make_val<Derived>(4));
+    auto ptr = vp.get();
+
+    auto d = value_ptr_cast<Derived>(std::move(vp));
+    REQUIRE(d.get() == ptr);
+    REQUIRE(d.holds<Derived>());
+  }
+
+  SECTION("through virtual bases")
+  {
+    auto vp = make_derived_val<VirtualBase, VirtualDerived>();
+    REQUIRE(value_ptr_cast<VirtualDerived>(vp) != nullptr);
+    REQUIRE(value_ptr_cast<VirtualDerived>(vp)->val() == 1);
+
+    auto d = value_ptr_cast<VirtualDerived>(std::move(vp));
+    REQUIRE(d->val() == 1);
+
+    auto b = value_ptr<VirtualBase>(d);
+    REQUIRE(b->val() == 1);
+
+    auto released = d.release();
+    REQUIRE(released->val() == 1);
+    delete released;
+  }
+}
+
+TEST_CASE("with_likely calls functions with the likely dynamic type")
+{
+  struct visitor {
+    int operator()(Derived& d) const { return d.v_ * 10; }
+    int operator()(Base& b) const { return b.val(); }
+  };
+
+  auto likely = make_derived_val<Base, Derived>(3);
+  REQUIRE(likely.with_likely<Derived>(visitor{}) == 30);
+
+  auto unlikely = make_derived_val<Base, MoreDerived>(3);
+  REQUIRE(unlikely.with_likely<Derived>(visitor{}) == -3);
+
+  auto base = make_val<Base>();
+  REQUIRE(base.with_likely<Derived>(visitor{}) == 0);
+}
+
 TEST_CASE("can convert to unique_pointer")
 {
   SECTION("values are propagated")
@@ -430,3 +570,663 @@ TEST_CASE("can convert to unique_pointer")
     REQUIRE(count == 0);
   }
 }
+
+TEST_CASE("values can be constructed in place")
+{
+  SECTION("with the element type")
+  {
+    auto count = 0;
+    {
+      auto vp = value_ptr<rc>(in_place_type_t<rc>{}, count);
+      REQUIRE(count == 1);
+
+      auto vp2 = vp;
+      REQUIRE(count == 2);
+    }
+    REQUIRE(count == 0);
+  }
+
+  SECTION("with a derived type")
+  {
+    auto vp = value_ptr<Base>(in_place_type_t<Derived>{}, 4);
+    REQUIRE(vp->val() == 4);
+
+    auto vp2 = vp;
+    REQUIRE(vp2->val() == 5);
+  }
+
+  SECTION("and then released")
+  {
+    auto count = 0;
+    auto vp = make_val<rc>(count);
+
+    auto ptr = vp.release();
+    REQUIRE(!vp);
+    REQUIRE(count == 1);
+
+    delete ptr;
+    REQUIRE(count == 0);
+  }
+}
+
+struct no_move {
+  no_move(int v)
+      : v_(v)
+  {
+  }
+
+  no_move(no_move const&) = default;
+  no_move(no_move&&) = delete;
+
+  int v_;
+};
+
+TEST_CASE("releasing in-place objects relocates them")
+{
+  SECTION("by moving")
+  {
+    auto vp = make_val<std::vector<int>>(3, 7);
+    auto old = vp.get();
+    auto data = vp->data();
+
+    auto ptr = vp.release();
+    REQUIRE(ptr != old);
+    REQUIRE(ptr->data() == data);
+    delete ptr;
+  }
+
+  SECTION("by copying types that can't be moved")
+  {
+    auto vp = make_val<no_move>(4);
+    auto old = vp.get();
+
+    auto ptr = vp.release();
+    REQUIRE(ptr != old);
+    REQUIRE(ptr->v_ == 4);
+    delete ptr;
+  }
+
+  SECTION("but not adopted objects")
+  {
+    auto raw = new no_move(5);
+    auto vp = value_ptr<no_move>(raw);
+
+    auto ptr = vp.release();
+    REQUIRE(ptr == raw);
+    delete ptr;
+  }
+}
+
+TEST_CASE("values can be emplaced")
+{
+  SECTION("into an empty value_ptr")
+  {
+    auto vp = value_ptr<Base>();
+    auto& d = vp.emplace<Derived>(7);
+
+    REQUIRE(&d == vp.get());
+    REQUIRE(vp->val() == 7);
+  }
+
+  SECTION("replacing an existing value")
+  {
+    auto count = 0;
+    auto vp = make_val<rc>(count);
+    REQUIRE(count == 1);
+
+    vp.emplace(count);
+    REQUIRE(count == 1);
+
+    vp.emplace<rc>(count);
+    REQUIRE(count == 1);
+
+    vp.reset();
+    REQUIRE(count == 0);
+  }
+}
+
+TEST_CASE("copy assignment reuses storage when dynamic types match")
+{
+  SECTION("for plain types")
+  {
+    auto a = make_val<int>(1);
+    auto b = make_val<int>(2);
+    auto ptr = a.get();
+
+    a = b;
+    REQUIRE(a.get() == ptr);
+    REQUIRE(*a == 2);
+    REQUIRE(b.get() != ptr);
+  }
+
+  SECTION("for polymorphic types")
+  {
+    auto a = make_derived_val<Base, Derived>(1);
+    auto b = make_derived_val<Base, Derived>(2);
+    auto ptr = a.get();
+
+    // Assigning in place copies b's object with Derived's (counting) copy
+    // constructor, then assigns the copy to a's object.
+    a = b;
+    REQUIRE(a.get() == ptr);
+    REQUIRE(a->val() == 3);
+  }
+
+  SECTION("falling back to copying when dynamic types differ")
+  {
+    auto a = make_val<Base>();
+    auto b = make_derived_val<Base, Derived>(2);
+
+    a = b;
+    REQUIRE(a.get() != b.get());
+    REQUIRE(a->val() == 3);
+
+    a = make_val<Base>();
+    REQUIRE(a->val() == 0);
+  }
+
+  SECTION("falling back to copying for non-assignable types")
+  {
+    auto count = 0;
+    auto a = make_val<rc>(count);
+    auto b = make_val<rc>(count);
+    REQUIRE(count == 2);
+
+    a = b;
+    REQUIRE(count == 2);
+    REQUIRE(a.get() != b.get());
+  }
+
+  SECTION("into and from empty value_ptrs")
+  {
+    auto a = value_ptr<int>();
+    auto b = make_val<int>(3);
+
+    a = b;
+    REQUIRE(*a == 3);
+
+    b = value_ptr<int>();
+    REQUIRE(!b);
+
+    a = b;
+    REQUIRE(!a);
+  }
+}
+
+struct string_node {
+  value_ptr<string_node> next;
+  std::string value;
+};
+
+struct Composite : Base {
+  Composite(std::string n)
+      : name(std::move(n))
+  {
+  }
+
+  value_ptr<Base> child;
+  std::string name;
+};
+
+TEST_CASE("copy assignment from an object owned by the destination")
+{
+  SECTION("of the same static type")
+  {
+    auto head = make_val<string_node>();
+    head->value = "a long enough string to be allocated: first";
+    head->next = make_val<string_node>();
+    head->next->value = "a long enough string to be allocated: second";
+    head->next->next = make_val<string_node>();
+    head->next->next->value = "a long enough string to be allocated: third";
+
+    head = head->next;
+    REQUIRE(head->value == "a long enough string to be allocated: second");
+    REQUIRE(head->next->value == "a long enough string to be allocated: third");
+    REQUIRE(!head->next->next);
+  }
+
+  SECTION("through a base class")
+  {
+    auto root = value_ptr<Base>(in_place_type_t<Composite>{}, "root");
+    auto& composite = static_cast<Composite&>(*root);
+    composite.child = make_derived_val<Base, Composite>("child");
+    static_cast<Composite&>(*composite.child).child
+        = make_derived_val<Base, Composite>("grandchild");
+
+    root = composite.child;
+    REQUIRE(root.holds<Composite>());
+
+    auto& new_root = static_cast<Composite&>(*root);
+    auto& child = static_cast<Composite&>(*new_root.child);
+    REQUIRE(new_root.name == "child");
+    REQUIRE(child.name == "grandchild");
+    REQUIRE(!child.child);
+  }
+}
+
+struct may_throw {
+  may_throw(bool should_throw)
+  {
+    if (should_throw) {
+      throw 0;
+    }
+  }
+};
+
+TEST_CASE("emplace and reset reuse storage that is large enough")
+{
+  SECTION("emplacing the same type")
+  {
+    auto count = 0;
+    auto vp = make_val<rc>(count);
+    auto ptr = vp.get();
+
+    vp.emplace(count);
+    REQUIRE(vp.get() == ptr);
+    REQUIRE(count == 1);
+  }
+
+  SECTION("emplacing a smaller type")
+  {
+    auto vp = make_derived_val<Base, Derived>(3);
+    vp.emplace<Base>();
+    REQUIRE(vp->val() == 0);
+
+    auto vp2 = vp;
+    REQUIRE(vp2->val() == 0);
+  }
+
+  SECTION("emplacing a larger type")
+  {
+    auto vp = make_val<Base>();
+    vp.emplace<Derived>(3);
+    REQUIRE(vp->val() == 3);
+  }
+
+  SECTION("resetting with a pointer")
+  {
+    auto count = 0;
+    auto vp = make_val<rc>(count);
+
+    vp.reset(new rc(count));
+    REQUIRE(count == 1);
+
+    vp.reset(new rc(count));
+    REQUIRE(count == 1);
+
+    auto vp2 = vp;
+    REQUIRE(count == 2);
+  }
+
+  SECTION("leaving the value_ptr empty if construction throws")
+  {
+    auto vp = make_val<may_throw>(false);
+    REQUIRE_THROWS(vp.emplace(true));
+    REQUIRE(!vp);
+  }
+}
+
+template <std::size_t Align>
+struct alignas(Align) aligned : Base {
+  aligned(int v)
+      : v_(v)
+  {
+  }
+
+  int val() override { return v_; }
+
+  int v_;
+  float lanes[8] = {};
+};
+
+template <typename T>
+bool is_aligned(T const* ptr, std::size_t align)
+{
+  return reinterpret_cast<std::uintptr_t>(ptr) % align == 0;
+}
+
+TEMPLATE_TEST_CASE("over-aligned objects are stored aligned", "",
+    aligned<32>, aligned<64>, aligned<4096>)
+{
+  constexpr auto align = alignof(TestType);
+
+  SECTION("constructing in place")
+  {
+    auto vp = make_val<TestType>(3);
+    REQUIRE(is_aligned(vp.get(), align));
+    REQUIRE(vp->val() == 3);
+
+    auto copy = vp;
+    REQUIRE(is_aligned(copy.get(), align));
+    REQUIRE(copy->val() == 3);
+  }
+
+  SECTION("copying as a base class")
+  {
+    auto vp = make_derived_val<Base, TestType>(4);
+    auto copy = vp;
+    REQUIRE(is_aligned(value_ptr_cast<TestType>(copy), align));
+    REQUIRE(copy->val() == 4);
+  }
+
+  SECTION("replacing objects of other alignments")
+  {
+    auto vp = value_ptr<Base>(in_place_type_t<aligned<4096>>{}, 1);
+    vp.emplace<TestType>(2);
+    REQUIRE(is_aligned(value_ptr_cast<TestType>(vp), align));
+    REQUIRE(vp->val() == 2);
+
+    vp.emplace<Base>();
+    REQUIRE(vp->val() == 0);
+
+    vp = make_derived_val<Base, TestType>(6);
+    vp = make_derived_val<Base, TestType>(7);
+    REQUIRE(is_aligned(value_ptr_cast<TestType>(vp), align));
+    REQUIRE(vp->val() == 7);
+  }
+
+  SECTION("converting between value_ptr types")
+  {
+    auto vp = value_ptr<Base>(make_val<TestType>(8));
+    auto copy = vp;
+    REQUIRE(is_aligned(value_ptr_cast<TestType>(copy), align));
+    REQUIRE(copy->val() == 8);
+  }
+}
+
+TEST_CASE("cache-aligned objects start on a cache line")
+{
+  auto vp = make_cache_aligned_val<int>(3);
+  REQUIRE(is_aligned(vp.get(), VP_CACHE_LINE_SIZE));
+  REQUIRE(*vp == 3);
+
+  auto copy = vp;
+  REQUIRE(is_aligned(copy.get(), VP_CACHE_LINE_SIZE));
+  REQUIRE(*copy == 3);
+
+  auto derived
+      = value_ptr<Base>(cache_aligned, in_place_type_t<Derived>{}, 4);
+  REQUIRE(is_aligned(value_ptr_cast<Derived>(derived), VP_CACHE_LINE_SIZE));
+  REQUIRE(derived->val() == 4);
+  REQUIRE(derived.holds<Derived>());
+}
+
+struct document {
+  std::vector<value_ptr<int>> parts;
+  value_ptr<document> child;
+};
+
+std::size_t deep_size_members(document const& doc)
+{
+  return doc.parts.capacity() * sizeof(value_ptr<int>)
+      + deep_size(doc.parts.begin(), doc.parts.end()) + deep_size(doc.child);
+}
+
+TEST_CASE("deep_size counts the memory a value_ptr owns")
+{
+  REQUIRE(value_ptr<int>().deep_size() == 0);
+
+  auto const inline_int = make_val<int>(1).deep_size();
+  REQUIRE(inline_int >= sizeof(int) + sizeof(void*));
+
+  SECTION("adopted objects count their separate allocation")
+  {
+    auto adopted = value_ptr<int>(new int(1));
+    REQUIRE(adopted.deep_size() >= inline_int);
+    REQUIRE(adopted.deep_size() >= sizeof(int) + 2 * sizeof(void*));
+  }
+
+  SECTION("objects report the memory they own")
+  {
+    auto leaf = make_val<document>();
+    auto const empty_size = leaf.deep_size();
+    REQUIRE(empty_size >= sizeof(document));
+
+    leaf->parts.reserve(4);
+    leaf->parts.push_back(make_val<int>(1));
+    leaf->parts.push_back(make_val<int>(2));
+    REQUIRE(leaf.deep_size()
+        == empty_size + 4 * sizeof(value_ptr<int>) + 2 * inline_int);
+
+    auto root = make_val<document>();
+    root->child = leaf;
+    REQUIRE(root.deep_size() == empty_size + root->child.deep_size());
+  }
+
+  SECTION("converted value_ptrs include the object they adapt")
+  {
+    auto derived = make_val<Derived>(1);
+    auto const derived_size = derived.deep_size();
+
+    auto base = value_ptr<Base>(std::move(derived));
+    REQUIRE(base.deep_size() > derived_size);
+  }
+
+  SECTION("ranges add up their elements")
+  {
+    auto values = std::vector<value_ptr<int>>{};
+    values.push_back(make_val<int>(1));
+    values.push_back(value_ptr<int>());
+    values.push_back(value_ptr<int>(new int(3)));
+
+    REQUIRE(deep_size(values.begin(), values.end())
+        == inline_int + values[2].deep_size());
+  }
+}
+
+TEST_CASE("empty value_ptrs return null from get and release")
+{
+  auto vp = value_ptr<int>();
+  REQUIRE(vp.get() == nullptr);
+  REQUIRE(vp.release() == nullptr);
+
+  auto vp2 = value_ptr<int>(static_cast<int*>(nullptr));
+  REQUIRE(!vp2);
+}
+
+struct counting_deleter {
+  template <typename U>
+  void operator()(U* ptr) const
+  {
+    ++*calls;
+    delete ptr;
+  }
+
+  int* calls;
+};
+
+TEST_CASE("value_ptr can adopt a unique_ptr")
+{
+  SECTION("without copying the object")
+  {
+    auto count = 0;
+    {
+      auto up = std::unique_ptr<rc>(new rc(count));
+      auto raw = up.get();
+
+      value_ptr<rc> vp = std::move(up);
+      REQUIRE(!up);
+      REQUIRE(vp.get() == raw);
+      REQUIRE(count == 1);
+    }
+    REQUIRE(count == 0);
+  }
+
+  SECTION("from a derived type")
+  {
+    auto vp = value_ptr<Base>(std::unique_ptr<Derived>(new Derived(4)));
+    REQUIRE(vp->val() == 4);
+
+    auto vp2 = vp;
+    REQUIRE(vp2->val() == 5);
+  }
+
+  SECTION("with from_unique")
+  {
+    auto vp = from_unique(std::unique_ptr<int>(new int(3)));
+    REQUIRE(*vp == 3);
+
+    auto empty = from_unique(std::unique_ptr<int>());
+    REQUIRE(!empty);
+  }
+
+  SECTION("keeping its deleter")
+  {
+    auto calls = 0;
+    {
+      auto up = std::unique_ptr<int, counting_deleter>(
+          new int(3), counting_deleter{ &calls });
+      auto vp = value_ptr<int>(std::move(up));
+
+      auto vp2 = vp;
+      REQUIRE(*vp2 == 3);
+    }
+    REQUIRE(calls == 1);
+  }
+
+  SECTION("and give it back without copying")
+  {
+    auto up = std::unique_ptr<int>(new int(8));
+    auto raw = up.get();
+
+    auto vp = value_ptr<int>(std::move(up));
+    auto up2 = vp.to_unique();
+    REQUIRE(up2.get() == raw);
+  }
+
+  SECTION("and release objects with custom deleters safely")
+  {
+    auto calls = 0;
+    auto vp = value_ptr<int>(std::unique_ptr<int, counting_deleter>(
+        new int(3), counting_deleter{ &calls }));
+
+    auto up = vp.to_unique();
+    REQUIRE(*up == 3);
+    REQUIRE(calls == 1);
+  }
+}
+
+struct chain_node {
+  chain_node(int v)
+      : value(v)
+      , next(nullptr)
+  {
+  }
+
+  int value;
+  value_ptr<chain_node> next;
+};
+
+namespace bsc {
+template <>
+struct enable_iterative_ownership<chain_node> : std::true_type {
+};
+} // namespace bsc
+
+struct tree_node {
+  value_ptr<tree_node> left;
+  value_ptr<tree_node> right;
+};
+
+namespace bsc {
+template <>
+struct enable_iterative_ownership<tree_node> : std::true_type {
+};
+} // namespace bsc
+
+struct assigning_node {
+  assigning_node(int v)
+      : value(v)
+  {
+  }
+
+  assigning_node(assigning_node const& o)
+      : value(o.value)
+  {
+    next = o.next;
+  }
+
+  int value;
+  value_ptr<assigning_node> next;
+};
+
+namespace bsc {
+template <>
+struct enable_iterative_ownership<assigning_node> : std::true_type {
+};
+} // namespace bsc
+
+TEST_CASE("deep chains are copied and destroyed iteratively")
+{
+  auto const length = 2000000;
+
+  auto head = value_ptr<chain_node>(nullptr);
+  for (auto i = 0; i < length; ++i) {
+    auto node = make_val<chain_node>(i);
+    node->next = std::move(head);
+    head = std::move(node);
+  }
+
+  auto copy = head;
+
+  auto n = 0;
+  auto distinct = true;
+  auto ordered = true;
+  for (auto p = &copy, q = &head; *p; p = &(*p)->next, q = &(*q)->next) {
+    distinct = distinct && p->get() != q->get();
+    ordered = ordered && (*p)->value == length - 1 - n;
+    ++n;
+  }
+
+  REQUIRE(n == length);
+  REQUIRE(distinct);
+  REQUIRE(ordered);
+
+  head.reset();
+  copy = nullptr;
+}
+
+TEST_CASE("iterative copy constructors can assign members in their body")
+{
+  auto const length = 1000;
+
+  auto head = value_ptr<assigning_node>(nullptr);
+  for (auto i = 0; i < length; ++i) {
+    auto node = make_val<assigning_node>(i);
+    node->next = std::move(head);
+    head = std::move(node);
+  }
+
+  auto copy = head;
+  auto assigned = value_ptr<assigning_node>(nullptr);
+  assigned = head;
+
+  for (auto c : { &copy, &assigned }) {
+    auto n = 0;
+    auto ok = true;
+    for (auto p = c, q = &head; *p; p = &(*p)->next, q = &(*q)->next) {
+      ok = ok && p->get() != q->get() && (*p)->value == length - 1 - n;
+      ++n;
+    }
+
+    REQUIRE(n == length);
+    REQUIRE(ok);
+  }
+}
+
+TEST_CASE("trees with iterative ownership keep their shape when copied")
+{
+  auto root = make_val<tree_node>();
+  root->left = make_val<tree_node>();
+  root->left->right = make_val<tree_node>();
+  root->right = make_val<tree_node>();
+
+  auto copy = root;
+  REQUIRE(copy.get() != root.get());
+  REQUIRE(copy->left);
+  REQUIRE(!copy->left->left);
+  REQUIRE(copy->left->right);
+  REQUIRE(copy->right);
+  REQUIRE(!copy->right->left);
+  REQUIRE(!copy->right->right);
+}